@@ -0,0 +1,59 @@
+// Import time of ObjReader against ASSIMP with the flags ModelAsset::LoadModel uses for the default vertex streams, for
+// every OBJ given on the command line. The bench_obj_reader target runs it on every OBJ below resources/.
+#include "ObjReader.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+// each import is repeated and the fastest run reported, the first one warms the page cache
+constexpr int def_bench_runs = 5;
+constexpr unsigned int def_import_flags = aiProcess_Triangulate | aiProcess_FlipUVs;
+
+template <typename Function>
+double BestMilliseconds(Function function) {
+  double best = 1e30;
+  for (int run = 0; run < def_bench_runs; run++) {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+}// namespace
+
+int main(const int argc, char *argv[]) {
+  if (argc < 2) {
+    std::printf("usage: %s file.obj...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  std::printf("%-48s %8s %10s %10s %8s\n", "file", "meshes", "obj ms", "assimp ms", "speedup");
+  for (int i = 1; i < argc; i++) {
+    const string path = argv[i];
+
+    vector<MeshData> meshes;
+    bool read = false;
+    const double obj_ms = BestMilliseconds([&]() {
+      meshes.clear();
+      read = ObjReader::Read(path, meshes, def_vertex_attributes);
+    });
+
+    size_t assimp_meshes = 0;
+    const double assimp_ms = BestMilliseconds([&]() {
+      Assimp::Importer importer;
+      const aiScene *scene = importer.ReadFile(path, def_import_flags);
+      assimp_meshes = scene ? scene->mNumMeshes : 0;
+    });
+
+    // files ObjReader rejects go through ASSIMP at runtime, their reader time is only the cost of finding out
+    if (!read) std::printf("%-48s %8zu %10s %10.2f %8s\n", path.c_str(), assimp_meshes, "rejected", assimp_ms, "-");
+    else std::printf("%-48s %8zu %10.2f %10.2f %7.1fx\n", path.c_str(), meshes.size(), obj_ms, assimp_ms, assimp_ms / obj_ms);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+// CPU cost of the per-draw uniform update of shader.vs, before and after Shader cached its uniforms: a std::string
+// and a glGetUniformLocation per draw as the old setMat4(const std::string &) did, the string setter reading the
+// reflected table, and a typed Uniform handle. Run from the repository root, or pass the shader directory; the bench_shader_uniforms target does.
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "Shader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+constexpr int def_bench_draws = 1000000;
+
+template <typename Function>
+double NanosecondsPerDraw(Function function) {
+  glFinish();
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < def_bench_draws; i++) function(i);
+  glFinish();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / def_bench_draws;
+}
+}// namespace
+
+int main(const int argc, char *argv[]) {
+  const std::string shader_directory = argc > 1 ? argv[1] : "./shader";
+  if (!glfwInit()) return EXIT_FAILURE;
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow *window = glfwCreateWindow(64, 64, "ShaderUniformBench", nullptr, nullptr);
+  if (!window) {
+    std::printf("could not create a GL 3.3 context\n");
+    glfwTerminate();
+    return EXIT_FAILURE;
+  }
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress))) return EXIT_FAILURE;
+
+  {
+    const Shader shader((shader_directory + "/shader.vs").c_str(), (shader_directory + "/shader.fs").c_str());
+    shader.use();
+    const Uniform<glm::mat4> model_uniform = shader.uniform<glm::mat4>("model");
+    glm::mat4 model(1.0f);
+    // the matrix changes every draw, as it does between models
+    const auto next = [&model](const int i) -> const glm::mat4 & {
+      model[3][0] = static_cast<float>(i & 1023);
+      return model;
+    };
+
+    const double lookup_ns = NanosecondsPerDraw([&](const int i) {
+      const std::string name("model");// the string the old setter was called with
+      glUniformMatrix4fv(glGetUniformLocation(shader.ID, name.c_str()), 1, GL_FALSE, &next(i)[0][0]);
+    });
+    const double name_ns = NanosecondsPerDraw([&](const int i) { shader.setMat4("model", next(i)); });
+    const double handle_ns = NanosecondsPerDraw([&](const int i) { shader.set(model_uniform, next(i)); });
+
+    std::printf("%d draws, model matrix per draw\n", def_bench_draws);
+    std::printf("  string + glGetUniformLocation %7.1f ns\n", lookup_ns);
+    std::printf("  setMat4 by name (cached)      %7.1f ns\n", name_ns);
+    std::printf("  set(Uniform<mat4>)            %7.1f ns\n", handle_ns);
+  }
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return EXIT_SUCCESS;
+}
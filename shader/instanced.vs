@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 8) in mat4 aInstanceModel; // per-instance model matrix, locations 8 to 11, see ModelInstances
+
+out vec2 TexCoords;
+
+// per-frame values shared by every program, see FrameConstants.h
+layout (std140) uniform FrameConstants
+{
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_position;
+    float time;
+};
+
+void main()
+{
+    TexCoords = aTexCoords;    
+    gl_Position = view_projection * aInstanceModel * vec4(aPos, 1.0);
+}
@@ -6,6 +6,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <cmath>
 #include <vector>
 
 // Defines several possible options for camera movement.
@@ -26,6 +27,41 @@ constexpr float def_speed = 50.0f;
 constexpr float def_sensitivity = 0.1f;
 constexpr float def_zoom = 45.0f;
 
+// The six clip planes of a view-projection matrix (Gribb-Hartmann), normals pointing inwards: left, right, bottom,
+// top, near, far. Tests are conservative: a volume near a frustum corner may be reported visible although it is not.
+struct Frustum {
+  glm::vec4 planes[6];
+
+  static Frustum FromMatrix(const glm::mat4 &view_projection) {
+    Frustum frustum;
+    const glm::mat4 m = glm::transpose(view_projection);// rows of view_projection as columns
+    for (int i = 0; i < 3; i++) {
+      frustum.planes[2 * i] = m[3] + m[i];
+      frustum.planes[2 * i + 1] = m[3] - m[i];
+    }
+    for (auto &plane : frustum.planes) plane /= glm::length(glm::vec3(plane));
+    return frustum;
+  }
+
+  bool IntersectsSphere(const glm::vec3 &center, const float radius) const {
+    for (const auto &plane : planes)
+      if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+    return true;
+  }
+
+  // box given in model space, placed by model; tested as the world-space box enclosing it
+  bool IntersectsBox(const glm::mat4 &model, const glm::vec3 &box_min, const glm::vec3 &box_max) const {
+    const glm::vec3 center = glm::vec3(model * glm::vec4((box_min + box_max) * 0.5f, 1.0f));
+    const glm::vec3 half = (box_max - box_min) * 0.5f;
+    const glm::vec3 extent = glm::abs(glm::vec3(model[0])) * half.x + glm::abs(glm::vec3(model[1])) * half.y + glm::abs(glm::vec3(model[2])) * half.z;
+    for (const auto &plane : planes) {
+      const glm::vec3 normal(plane);
+      if (glm::dot(normal, center) + plane.w < -glm::dot(glm::abs(normal), extent)) return false;
+    }
+    return true;
+  }
+};
+
 // An abstract camera class that processes input and calculates
 // the corresponding Euler Angles,Vectors and Matrices for use in OpenGL
 class Camera {
@@ -53,6 +89,12 @@ public:
   // returns the view matrix calculated using Euler Angles and the LookAt Matrix
   glm::mat4 get_view_matrix() const { return glm::lookAt(cam_position, cam_position + cam_front, cam_up); }
 
+  // the frustum seen through projection from the camera
+  Frustum get_frustum(const glm::mat4 &projection) const { return Frustum::FromMatrix(projection * get_view_matrix()); }
+
+  // pixels covered by one world unit at distance one, for a viewport viewport_height pixels high
+  float get_projection_scale(const float viewport_height) const { return viewport_height / (2.0f * std::tan(glm::radians(cam_zoom) * 0.5f)); }
+
   // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
   void process_keyboard(const camera_movement direction, const float delta_time) {
     const float velocity = cam_movement_speed * delta_time;
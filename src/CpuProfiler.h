@@ -0,0 +1,188 @@
+#pragma once
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// zones each thread keeps; older ones are overwritten. 64k zones last well over a minute at a few hundred per frame.
+constexpr size_t def_cpu_zone_ring = 1 << 16;
+// zones a thread may have open at once; deeper ones are not recorded
+constexpr size_t def_cpu_zone_depth = 64;
+// span written by a trace dump when none is given
+constexpr double def_cpu_trace_seconds = 5.0;
+
+// one closed zone, in nanoseconds since the profiler started
+struct CpuZoneEvent {
+  const char *name;
+  int64_t start_ns;
+  int64_t end_ns;
+};
+
+// Scoped CPU zones. Every thread records the zones it closes into a ring of its own: recording takes two clock reads
+// and no lock, the ring is only registered under a mutex the first time a thread records. WriteChromeTrace copies the
+// rings and writes the zones of the last seconds as Chrome trace JSON, to be opened in chrome://tracing or Perfetto.
+// A zone overwritten while it is being copied is left out of the dump: the ring slots are relaxed atomics, checked like
+// a seqlock against the count of recorded zones. Zone and thread names must outlive the profiler, string literals are
+// expected.
+class CpuProfiler {
+public:
+  static CpuProfiler &Global() {
+    static CpuProfiler profiler;
+    return profiler;
+  }
+
+  // times the enclosing block as zone name
+  class Scope {
+  public:
+    explicit Scope(const char *name) { Global().Begin(name); }
+    ~Scope() { Global().End(); }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+  // zones must be closed by the thread that opened them, innermost first
+  void Begin(const char *name) {
+    ThreadRing &ring = LocalRing();
+    if (ring.depth < def_cpu_zone_depth) {
+      ring.open[ring.depth].name = name;
+      ring.open[ring.depth].start_ns = enabled.load(std::memory_order_relaxed) ? Now() : -1;
+    }
+    ring.depth++;
+  }
+
+  void End() {
+    ThreadRing &ring = LocalRing();
+    if (ring.depth == 0 || --ring.depth >= def_cpu_zone_depth) return;
+    CpuZoneEvent event = ring.open[ring.depth];
+    if (event.start_ns < 0) return;
+    event.end_ns = Now();
+    const uint64_t index = ring.written.load(std::memory_order_relaxed);
+    Slot &slot = ring.events[index % def_cpu_zone_ring];
+    // keeps the overwrite after the count of the previous zone, so a dump that reads this slot half written also sees
+    // the count moved past it
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(event.name, std::memory_order_relaxed);
+    slot.start_ns.store(event.start_ns, std::memory_order_relaxed);
+    slot.end_ns.store(event.end_ns, std::memory_order_relaxed);
+    ring.written.store(index + 1, std::memory_order_release);
+  }
+
+  // names the calling thread in traces
+  void SetThreadName(const char *name) { LocalRing().name.store(name, std::memory_order_relaxed); }
+
+  // zones opened while disabled are not recorded
+  void SetEnabled(const bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+  bool Enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+  // writes the zones every thread closed during the last seconds to path. returns the number of zones written, or 0
+  // when the file could not be written.
+  size_t WriteChromeTrace(const std::string &path, const double seconds = def_cpu_trace_seconds) {
+    const int64_t since = Now() - static_cast<int64_t>(seconds * 1e9);
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+      std::cout << "ERROR::CPU_PROFILER:: could not write " << path << '\n';
+      return 0;
+    }
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    size_t zones = 0;
+    bool first = true;
+    std::vector<CpuZoneEvent> events;
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (size_t tid = 0; tid < rings.size(); tid++) {
+      const ThreadRing &ring = *rings[tid];
+      Copy(ring, events);
+      out << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":";
+      const char *thread_name = ring.name.load(std::memory_order_relaxed);
+      WriteString(out, thread_name ? thread_name : "thread");
+      out << "}}";
+      first = false;
+      for (const auto &event : events) {
+        if (event.end_ns < since) continue;
+        out << ",{\"name\":";
+        WriteString(out, event.name);
+        out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << event.start_ns / 1000.0 << ",\"dur\":" << (event.end_ns - event.start_ns) / 1000.0
+            << '}';
+        zones++;
+      }
+    }
+    out << "]}\n";
+    if (!out) {
+      std::cout << "ERROR::CPU_PROFILER:: could not write " << path << '\n';
+      return 0;
+    }
+    std::cout << "INFO::CPU_PROFILER:: wrote " << zones << " zones of the last " << seconds << " s to " << path << '\n';
+    return zones;
+  }
+
+private:
+  // a recorded zone as its thread writes it while a dump may be reading it
+  struct Slot {
+    std::atomic<const char *> name;
+    std::atomic<int64_t> start_ns;
+    std::atomic<int64_t> end_ns;
+  };
+
+  struct ThreadRing {
+    std::atomic<const char *> name{nullptr};
+    CpuZoneEvent open[def_cpu_zone_depth];// zones begun and not yet ended, end_ns unused; only touched by the thread
+    size_t depth = 0;
+    std::unique_ptr<Slot[]> events{new Slot[def_cpu_zone_ring]()};
+    std::atomic<uint64_t> written{0};// zones ever recorded; the last def_cpu_zone_ring of them are in events
+  };
+
+  const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+  std::atomic<bool> enabled{true};
+  // rings are never freed, a thread that exits leaves its zones for later dumps
+  std::vector<std::unique_ptr<ThreadRing>> rings;
+  std::mutex rings_mutex;
+
+  int64_t Now() const { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count(); }
+
+  ThreadRing &LocalRing() {
+    static thread_local ThreadRing *local = nullptr;
+    if (!local) {
+      std::unique_ptr<ThreadRing> ring(new ThreadRing());
+      local = ring.get();
+      std::lock_guard<std::mutex> lock(rings_mutex);
+      rings.push_back(std::move(ring));
+    }
+    return *local;
+  }
+
+  // copies the recorded zones of ring oldest first, dropping the ones its thread overwrote meanwhile
+  static void Copy(const ThreadRing &ring, std::vector<CpuZoneEvent> &events) {
+    const uint64_t end = ring.written.load(std::memory_order_acquire);
+    const uint64_t begin = end > def_cpu_zone_ring ? end - def_cpu_zone_ring : 0;
+    events.clear();
+    for (uint64_t i = begin; i < end; i++) {
+      const Slot &slot = ring.events[i % def_cpu_zone_ring];
+      events.push_back(CpuZoneEvent{slot.name.load(std::memory_order_relaxed), slot.start_ns.load(std::memory_order_relaxed), slot.end_ns.load(std::memory_order_relaxed)});
+    }
+    // pairs with the fence in End: a slot read while being overwritten means `after` already counts the overwrite,
+    // and the zone being written after `after` is the one that overwrites index after - def_cpu_zone_ring
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t after = ring.written.load(std::memory_order_relaxed);
+    const uint64_t valid = after + 1 > def_cpu_zone_ring ? after + 1 - def_cpu_zone_ring : 0;
+    if (valid > begin) events.erase(events.begin(), events.begin() + static_cast<std::ptrdiff_t>(std::min(valid - begin, end - begin)));
+  }
+
+  static void WriteString(std::ostream &out, const char *text) {
+    out << '"';
+    for (; *text; text++) {
+      if (*text == '"' || *text == '\\') out << '\\';
+      out << *text;
+    }
+    out << '"';
+  }
+};
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef FRAME_CONSTANTS_H
+#define FRAME_CONSTANTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+
+// uniform buffer binding point of the FrameConstants block; every Shader links its block here
+constexpr GLuint def_frame_constants_binding = 0;
+// name of the uniform block in GLSL
+constexpr const char *def_frame_constants_block = "FrameConstants";
+
+// Per-frame values shared by every program, laid out as the std140 block
+//
+//   layout(std140) uniform FrameConstants {
+//     mat4 view;
+//     mat4 projection;
+//     mat4 view_projection;
+//     vec4 camera_position;// w unused
+//     float time;
+//   };
+struct FrameConstants {
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 view_projection;
+  glm::vec4 camera_position;
+  float time;
+  float padding[3];// std140 rounds the block up to a multiple of 16 bytes
+};
+static_assert(sizeof(FrameConstants) == 224, "FrameConstants must match the std140 layout of the GLSL block");
+
+// The uniform buffer holding FrameConstants. It is uploaded and bound once per frame, so adding programs adds no
+// per-frame uniform traffic. All calls must be made on the thread owning the GL context.
+class FrameConstantsBuffer {
+public:
+  static FrameConstantsBuffer &Global() {
+    static FrameConstantsBuffer buffer;
+    return buffer;
+  }
+
+  // uploads constants and binds the buffer to def_frame_constants_binding. Call once per frame before drawing.
+  void Update(const FrameConstants &constants) {
+    if (!ubo) glGenBuffers(1, &ubo);
+    GLState::Global().BindBuffer(GL_UNIFORM_BUFFER, ubo);
+    // orphan the previous frame's storage so the upload never waits for draws still reading it
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameConstants), &constants);
+    GLState::Global().BindBufferBase(GL_UNIFORM_BUFFER, def_frame_constants_binding, ubo);
+  }
+
+  // deletes the buffer. Call before the context is destroyed.
+  void Clear() {
+    GLState::Global().DeleteBuffers(1, &ubo);
+    ubo = 0;
+  }
+
+private:
+  GLuint ubo = 0;
+};
+#endif
@@ -0,0 +1,154 @@
+#pragma once
+#ifndef FUSION_PAYLOAD_H
+#define FUSION_PAYLOAD_H
+
+#include "ecal/ecal_payload_writer.h"
+#include "fusion.pb.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Writes a FusionData message straight into eCAL's shared memory file. With CPublisher::ShmEnableZeroCopy the message
+// is serialized into the file by WriteFull, and when only values changed since then WriteModified overwrites the
+// changed floats where they already are, so a steady publish allocates nothing and copies nothing twice.
+//
+// Every field of FusionData is a float, directly or one sub-message down, so the encoding only changes shape when a
+// float turns zero or non-zero (proto3 leaves zeros out). WriteModified checks for that and falls back to WriteFull.
+// Floats are patched in host byte order, which is the little-endian order of the wire format on every target we
+// build for. The message must outlive the payload and may only change between sends.
+class FusionPayload : public eCAL::CPayloadWriter {
+public:
+  explicit FusionPayload(pb::FusionData::FusionData &fusion_message) : message(fusion_message) {
+    // the sub-messages are created up front so they are always serialized and their addresses stay put
+    const google::protobuf::Descriptor *descriptor = message.GetDescriptor();
+    const google::protobuf::Reflection *reflection = message.GetReflection();
+    for (int i = 0; i < descriptor->field_count(); i++) {
+      const google::protobuf::FieldDescriptor *field = descriptor->field(i);
+      if (field->type() == google::protobuf::FieldDescriptor::TYPE_FLOAT) AddField(message, field, 0);
+      else if (field->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE && !field->is_repeated()) {
+        google::protobuf::Message *sub_message = reflection->MutableMessage(&message, field);
+        const google::protobuf::Descriptor *sub_descriptor = sub_message->GetDescriptor();
+        for (int j = 0; j < sub_descriptor->field_count(); j++) {
+          const google::protobuf::FieldDescriptor *sub_field = sub_descriptor->field(j);
+          if (sub_field->type() == google::protobuf::FieldDescriptor::TYPE_FLOAT) AddField(*sub_message, sub_field, field->number());
+          else patchable = false;
+        }
+      } else patchable = false;
+    }
+    // protoc before 3.15 or so leaves -0.0f out like 0.0f, later versions keep it; ask the generated code which it does
+    if (!fields.empty()) {
+      std::unique_ptr<google::protobuf::Message> probe(fields.front().owner->New());
+      probe->GetReflection()->SetFloat(probe.get(), fields.front().field, -0.0f);
+      negative_zero_present = probe->ByteSizeLong() != 0;
+    }
+  }
+
+  bool WriteFull(void *buffer, const size_t size) override {
+    sends.fetch_add(1, std::memory_order_relaxed);
+    if (!message.SerializeToArray(buffer, static_cast<int>(size))) return false;
+    layout_size = message.GetCachedSize();
+    if (patchable && !Locate(static_cast<const uint8_t *>(buffer), layout_size)) layout_size = 0;
+    return true;
+  }
+
+  bool WriteModified(void *buffer, const size_t size) override {
+    if (!patchable || layout_size == 0 || size != layout_size) return WriteFull(buffer, size);
+    auto *bytes = static_cast<uint8_t *>(buffer);
+    for (const auto &entry : fields) {
+      const float value = entry.reflection->GetFloat(*entry.owner, entry.field);
+      const bool present = value != 0 || (negative_zero_present && std::signbit(value));// NaN is present too
+      if (present != (entry.offset != def_absent)) return WriteFull(buffer, size);// a float appeared or vanished
+      if (present && std::memcmp(bytes + entry.offset, &value, sizeof(value)) != 0) std::memcpy(bytes + entry.offset, &value, sizeof(value));
+    }
+    sends.fetch_add(1, std::memory_order_relaxed);
+    patched_sends.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // eCAL asks once per send, before writing. The size is kept for LastSize.
+  size_t GetSize() override {
+    last_size = message.ByteSizeLong();
+    return last_size;
+  }
+
+  // the size the last GetSize returned, what a successful send reports having sent
+  size_t LastSize() const { return last_size; }
+
+  // messages written, and those of them that only patched floats instead of serializing. Readable from any thread.
+  uint64_t Sends() const { return sends.load(std::memory_order_relaxed); }
+  uint64_t PatchedSends() const { return patched_sends.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr size_t def_absent = ~static_cast<size_t>(0);
+
+  struct Field {
+    const google::protobuf::Message *owner;
+    const google::protobuf::Reflection *reflection;
+    const google::protobuf::FieldDescriptor *field;
+    int parent_number;// field number of the sub-message holding it, 0 at the top level
+    size_t offset;    // of its value in the last full write, def_absent when it was left out
+  };
+
+  pb::FusionData::FusionData &message;
+  std::vector<Field> fields;
+  bool patchable = true;// false when the message has fields this payload cannot patch
+  bool negative_zero_present = false;// whether the serializer writes -0.0f
+  size_t layout_size = 0;// bytes of the last full write whose offsets are known, 0 when none
+  size_t last_size = 0;
+  std::atomic<uint64_t> sends{0};
+  std::atomic<uint64_t> patched_sends{0};
+
+  void AddField(const google::protobuf::Message &owner, const google::protobuf::FieldDescriptor *field, const int parent_number) {
+    fields.push_back(Field{&owner, owner.GetReflection(), field, parent_number, def_absent});
+  }
+
+  // finds the offset of every float in the encoded message. returns false on anything but floats and sub-messages.
+  bool Locate(const uint8_t *bytes, const size_t size) {
+    for (auto &entry : fields) entry.offset = def_absent;
+    return Locate(bytes, 0, size, 0);
+  }
+
+  bool Locate(const uint8_t *bytes, size_t position, const size_t end, const int parent_number) {
+    while (position < end) {
+      uint64_t tag;
+      if (!ReadVarint(bytes, position, end, tag)) return false;
+      const int number = static_cast<int>(tag >> 3);
+      switch (tag & 7) {
+        case 5:// fixed32
+          if (position + 4 > end) return false;
+          for (auto &entry : fields)
+            if (entry.parent_number == parent_number && entry.field->number() == number) entry.offset = position;
+          position += 4;
+          break;
+        case 2: {// length-delimited, a sub-message
+          uint64_t length;
+          if (parent_number != 0 || !ReadVarint(bytes, position, end, length) || position + length > end) return false;
+          if (!Locate(bytes, position, position + static_cast<size_t>(length), number)) return false;
+          position += static_cast<size_t>(length);
+          break;
+        }
+        default: return false;
+      }
+    }
+    return true;
+  }
+
+  static bool ReadVarint(const uint8_t *bytes, size_t &position, const size_t end, uint64_t &value) {
+    value = 0;
+    for (int shift = 0; position < end && shift < 64; shift += 7) {
+      const uint8_t byte = bytes[position++];
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) return true;
+    }
+    return false;
+  }
+};
+#endif
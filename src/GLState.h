@@ -0,0 +1,180 @@
+#pragma once
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// texture units whose GL_TEXTURE_2D binding GLState tracks; binds on higher units always reach the driver
+constexpr GLuint def_tracked_texture_units = 32;
+
+// calls that went through GLState since the last ResetStats
+struct GLStateStats {
+  size_t issued = 0;  // reached the driver
+  size_t filtered = 0;// skipped, the state was already set
+};
+
+// Shadow copy of the GL binding state that filters redundant calls before they reach the driver. It only knows about
+// calls made through it: code that changes the same state directly must call Invalidate afterwards, and objects must
+// be deleted through it so their names are forgotten before GL reuses them. Element array buffers are part of the
+// VAO and are passed through untracked. Every setter returns true if it issued the call. All calls must be made on the
+// thread owning the GL context.
+class GLState {
+public:
+  static GLState &Global() {
+    static GLState state;
+    return state;
+  }
+
+  GLState() { Invalidate(); }
+
+  bool UseProgram(const GLuint program) {
+    if (!Changes(current_program, program)) return false;
+    glUseProgram(program);
+    return true;
+  }
+
+  bool BindVertexArray(const GLuint vao) {
+    if (!Changes(current_vao, vao)) return false;
+    glBindVertexArray(vao);
+    return true;
+  }
+
+  bool BindBuffer(const GLenum target, const GLuint buffer) {
+    GLuint *cached = BufferSlot(target);
+    if (cached && !Changes(*cached, buffer)) return false;
+    if (!cached) stats.issued++;
+    glBindBuffer(target, buffer);
+    return true;
+  }
+
+  // binds buffer to an indexed binding point, which also makes it the generic binding of target
+  void BindBufferBase(const GLenum target, const GLuint index, const GLuint buffer) {
+    glBindBufferBase(target, index, buffer);
+    stats.issued++;
+    if (GLuint *cached = BufferSlot(target)) *cached = buffer;
+  }
+
+  bool ActiveTexture(const GLuint unit) {
+    if (!Changes(current_unit, unit)) return false;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    return true;
+  }
+
+  // binds texture to GL_TEXTURE_2D of unit, selecting the unit first when needed
+  bool BindTexture(const GLuint unit, const GLuint texture) {
+    if (unit < def_tracked_texture_units && unit_textures[unit] == texture) {
+      stats.filtered++;
+      return false;
+    }
+    ActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    stats.issued++;
+    if (unit < def_tracked_texture_units) unit_textures[unit] = texture;
+    return true;
+  }
+
+  // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+  bool BindFramebuffer(const GLenum target, const GLuint framebuffer) {
+    const bool draw = target != GL_READ_FRAMEBUFFER, read = target != GL_DRAW_FRAMEBUFFER;
+    if ((!draw || draw_framebuffer == framebuffer) && (!read || read_framebuffer == framebuffer)) {
+      stats.filtered++;
+      return false;
+    }
+    glBindFramebuffer(target, framebuffer);
+    stats.issued++;
+    if (draw) draw_framebuffer = framebuffer;
+    if (read) read_framebuffer = framebuffer;
+    return true;
+  }
+
+  bool SetDepthTest(const bool enabled) {
+    if (!Changes(depth_test, enabled ? 1 : 0)) return false;
+    if (enabled) glEnable(GL_DEPTH_TEST);
+    else glDisable(GL_DEPTH_TEST);
+    return true;
+  }
+
+  // core profile only has GL_FRONT_AND_BACK
+  bool SetPolygonMode(const GLenum mode) {
+    if (!Changes(polygon_mode, mode)) return false;
+    glPolygonMode(GL_FRONT_AND_BACK, mode);
+    return true;
+  }
+
+  void DeleteTextures(const GLsizei count, const GLuint *textures) {
+    for (GLsizei i = 0; i < count; i++)
+      for (auto &bound : unit_textures)
+        if (bound == textures[i]) bound = 0;
+    glDeleteTextures(count, textures);
+  }
+
+  void DeleteBuffers(const GLsizei count, const GLuint *buffers) {
+    for (GLsizei i = 0; i < count; i++)
+      for (auto &bound : buffers_bound)
+        if (bound == buffers[i]) bound = 0;
+    glDeleteBuffers(count, buffers);
+  }
+
+  void DeleteFramebuffers(const GLsizei count, const GLuint *framebuffers) {
+    for (GLsizei i = 0; i < count; i++) {
+      if (draw_framebuffer == framebuffers[i]) draw_framebuffer = 0;
+      if (read_framebuffer == framebuffers[i]) read_framebuffer = 0;
+    }
+    glDeleteFramebuffers(count, framebuffers);
+  }
+
+  void DeleteVertexArrays(const GLsizei count, const GLuint *vaos) {
+    for (GLsizei i = 0; i < count; i++)
+      if (current_vao == vaos[i]) current_vao = 0;
+    glDeleteVertexArrays(count, vaos);
+  }
+
+  // forgets everything, so the next call of each kind reaches the driver
+  void Invalidate() {
+    current_program = current_vao = current_unit = draw_framebuffer = read_framebuffer = polygon_mode = def_unknown;
+    for (auto &bound : buffers_bound) bound = def_unknown;
+    for (auto &bound : unit_textures) bound = def_unknown;
+    depth_test = def_unknown;
+  }
+
+  const GLStateStats &Stats() const { return stats; }
+  void ResetStats() { stats = GLStateStats(); }
+
+private:
+  static constexpr GLuint def_unknown = ~0u;// no GL name or enum has this value
+
+  GLuint current_program;
+  GLuint current_vao;
+  GLuint current_unit;
+  GLuint buffers_bound[4];// GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_PACK_BUFFER
+  GLuint unit_textures[def_tracked_texture_units];
+  GLuint draw_framebuffer;
+  GLuint read_framebuffer;
+  GLuint polygon_mode;
+  GLuint depth_test;
+  GLStateStats stats;
+
+  // records value and returns true if it differs from cached
+  bool Changes(GLuint &cached, const GLuint value) {
+    if (cached == value) {
+      stats.filtered++;
+      return false;
+    }
+    cached = value;
+    stats.issued++;
+    return true;
+  }
+
+  GLuint *BufferSlot(const GLenum target) {
+    switch (target) {
+      case GL_ARRAY_BUFFER: return &buffers_bound[0];
+      case GL_UNIFORM_BUFFER: return &buffers_bound[1];
+      case GL_PIXEL_UNPACK_BUFFER: return &buffers_bound[2];
+      case GL_PIXEL_PACK_BUFFER: return &buffers_bound[3];
+      default: return nullptr;
+    }
+  }
+};
+#endif
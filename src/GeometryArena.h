@@ -0,0 +1,329 @@
+#pragma once
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// size of a new vertex / index buffer page; a mesh larger than that gets a page of its own size
+constexpr size_t def_arena_vertex_page_bytes = 4 * 1024 * 1024;
+constexpr size_t def_arena_index_page_bytes = 2 * 1024 * 1024;
+// a page is compacted once the holes below its last allocation exceed this fraction of its capacity
+constexpr float def_arena_compact_waste = 0.25f;
+
+// where the geometry of one allocation currently lives. base_vertex and index_offset change when its page is
+// compacted, the VAO never does.
+struct GeometryRange {
+  GLuint vao;
+  GLint base_vertex;
+  size_t index_offset;// in bytes
+};
+
+// Static geometry of all meshes, suballocated from a few large vertex and index buffers. Each page holds meshes of a
+// single vertex layout and has one VAO, so meshes of a page are drawn with glDrawElementsBaseVertex without
+// rebinding buffers and can be merged into glMultiDrawElementsBaseVertex batches. Freed ranges are reused, and
+// Compact moves the survivors of fragmented pages together. All calls must be made on the thread owning the GL context.
+class GeometryArena {
+public:
+  using Handle = uint32_t;
+  static constexpr Handle def_invalid_handle = ~0u;
+
+  static GeometryArena &Global() {
+    static GeometryArena arena;
+    return arena;
+  }
+
+  // uploads the streams into a page of their layout and returns the handle of the allocation
+  Handle Allocate(const VertexLayout &layout, const void *vertex_data, const uint32_t vertex_count, const void *index_data, const size_t index_bytes) {
+    const size_t vertex_bytes = static_cast<size_t>(vertex_count) * layout.stride;
+    const size_t index_span = AlignUp(index_bytes);
+    Allocation allocation;
+    size_t page = 0;
+    for (; page < pages.size(); page++) {
+      Page &candidate = pages[page];
+      if (!candidate.vao || candidate.layout.attributes != layout.attributes) continue;
+      if (!candidate.vertex_free.Fits(vertex_count) || !candidate.index_free.Fits(index_span)) continue;
+      break;
+    }
+    if (page == pages.size() || !pages[page].vao) page = CreatePage(layout, vertex_bytes, index_span);
+
+    Page &target = pages[page];
+    allocation.page = static_cast<uint32_t>(page);
+    allocation.first_vertex = target.vertex_free.Take(vertex_count);
+    allocation.vertex_count = vertex_count;
+    allocation.index_offset = target.index_free.Take(index_span);
+    allocation.index_bytes = index_span;
+    allocation.live = true;
+    target.live++;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, target.vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.first_vertex * layout.stride), static_cast<GLsizeiptr>(vertex_bytes), vertex_data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, target.ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.index_offset), static_cast<GLsizeiptr>(index_bytes), index_data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    allocation.range = GeometryRange{target.vao, static_cast<GLint>(allocation.first_vertex), allocation.index_offset};
+
+    Handle handle;
+    if (!free_handles.empty()) {
+      handle = free_handles.back();
+      free_handles.pop_back();
+      allocations[handle] = allocation;
+    } else {
+      handle = static_cast<Handle>(allocations.size());
+      allocations.push_back(allocation);
+    }
+    return handle;
+  }
+
+  // returns the ranges of handle to their page; a page left empty is deleted
+  void Free(const Handle handle) {
+    if (handle >= allocations.size() || !allocations[handle].live) return;
+    Allocation &allocation = allocations[handle];
+    Page &page = pages[allocation.page];
+    page.vertex_free.Give(allocation.first_vertex, allocation.vertex_count);
+    page.index_free.Give(allocation.index_offset, allocation.index_bytes);
+    allocation.live = false;
+    free_handles.push_back(handle);
+    if (--page.live == 0) DeletePage(page);
+  }
+
+  const GeometryRange &Range(const Handle handle) const { return allocations[handle].range; }
+
+  // points the instance matrix attributes of vao at buffer, see ApplyInstanceMatrix. Meshes of a page share the VAO,
+  // so this is tracked per page and redone whenever another instance buffer is drawn from it. Leaves the VAO bound.
+  void AttachInstances(const GLuint vao, const GLuint instance_buffer) {
+    GLState::Global().BindVertexArray(vao);
+    for (auto &page : pages) {
+      if (page.vao != vao) continue;
+      if (page.instance_buffer == instance_buffer) return;
+      GLState::Global().BindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+      ApplyInstanceMatrix();
+      page.instance_buffer = instance_buffer;
+      return;
+    }
+  }
+
+  // forgets instance_buffer wherever it is attached. Call before deleting the buffer: GL may hand its name to a new
+  // buffer, which AttachInstances would then take for the deleted one.
+  void DetachInstances(const GLuint instance_buffer) {
+    if (!instance_buffer) return;
+    for (auto &page : pages)
+      if (page.instance_buffer == instance_buffer) page.instance_buffer = 0;
+  }
+
+  // compacts every page whose holes exceed max_waste of its capacity. Returns the number of pages compacted.
+  // Call between frames: ranges read before a compaction are stale afterwards.
+  size_t Compact(const float max_waste = def_arena_compact_waste) {
+    size_t compacted = 0;
+    for (size_t page = 0; page < pages.size(); page++) {
+      if (!pages[page].vao) continue;
+      const Page &p = pages[page];
+      const size_t vertex_waste = p.vertex_free.Holes() * p.layout.stride, index_waste = p.index_free.Holes();
+      if (vertex_waste <= max_waste * p.vertex_capacity * p.layout.stride && index_waste <= max_waste * p.index_capacity) continue;
+      CompactPage(page);
+      compacted++;
+    }
+    return compacted;
+  }
+
+  size_t PageCount() const {
+    size_t count = 0;
+    for (const auto &page : pages) count += page.vao != 0;
+    return count;
+  }
+
+  // bytes of vertex and index data held by live allocations
+  size_t UsedBytes() const {
+    size_t bytes = 0;
+    for (const auto &allocation : allocations)
+      if (allocation.live) bytes += allocation.vertex_count * pages[allocation.page].layout.stride + allocation.index_bytes;
+    return bytes;
+  }
+
+  // bytes of buffer storage of all pages
+  size_t CapacityBytes() const {
+    size_t bytes = 0;
+    for (const auto &page : pages)
+      if (page.vao) bytes += page.vertex_capacity * page.layout.stride + page.index_capacity;
+    return bytes;
+  }
+
+  // deletes every page regardless of live allocations. Call before the context is destroyed.
+  void Clear() {
+    for (auto &page : pages)
+      if (page.vao) DeletePage(page);
+    pages.clear();
+    allocations.clear();
+    free_handles.clear();
+  }
+
+private:
+  // first-fit list of free [offset, offset + size) spans, sorted by offset
+  struct FreeList {
+    struct Span {
+      size_t offset, size;
+    };
+    std::vector<Span> spans;
+    size_t capacity = 0;
+
+    bool Fits(const size_t size) const {
+      for (const auto &span : spans)
+        if (span.size >= size) return true;
+      return false;
+    }
+
+    size_t Take(const size_t size) {
+      for (size_t i = 0; i < spans.size(); i++) {
+        if (spans[i].size < size) continue;
+        const size_t offset = spans[i].offset;
+        spans[i].offset += size;
+        spans[i].size -= size;
+        if (spans[i].size == 0) spans.erase(spans.begin() + static_cast<std::ptrdiff_t>(i));
+        return offset;
+      }
+      return 0;// callers check Fits first
+    }
+
+    void Give(const size_t offset, const size_t size) {
+      auto next = std::lower_bound(spans.begin(), spans.end(), offset, [](const Span &span, const size_t value) { return span.offset < value; });
+      next = spans.insert(next, Span{offset, size});
+      // merge with the following and the preceding span
+      if (next + 1 != spans.end() && next->offset + next->size == (next + 1)->offset) {
+        next->size += (next + 1)->size;
+        spans.erase(next + 1);
+      }
+      if (next != spans.begin() && (next - 1)->offset + (next - 1)->size == next->offset) {
+        (next - 1)->size += next->size;
+        spans.erase(next);
+      }
+    }
+
+    // free space that is not at the end of the page
+    size_t Holes() const {
+      size_t holes = 0;
+      for (const auto &span : spans)
+        if (span.offset + span.size != capacity) holes += span.size;
+      return holes;
+    }
+
+    void Reset(const size_t used) {
+      spans.clear();
+      if (used < capacity) spans.push_back(Span{used, capacity - used});
+    }
+  };
+
+  struct Page {
+    VertexLayout layout;
+    GLuint vao = 0, vbo = 0, ebo = 0;
+    size_t vertex_capacity = 0;// in vertices
+    size_t index_capacity = 0; // in bytes
+    FreeList vertex_free, index_free;
+    size_t live = 0;
+    GLuint instance_buffer = 0;// attached at def_instance_matrix_location, 0 for none
+  };
+
+  struct Allocation {
+    uint32_t page = 0;
+    size_t first_vertex = 0, vertex_count = 0;
+    size_t index_offset = 0, index_bytes = 0;
+    GeometryRange range{};
+    bool live = false;
+  };
+
+  std::vector<Page> pages;// deleted pages keep their slot with vao 0
+  std::vector<Allocation> allocations;
+  std::vector<Handle> free_handles;
+
+  // index ranges start on 4 bytes so 16 and 32 bit indices can share a buffer
+  static size_t AlignUp(const size_t bytes) { return (bytes + 3) & ~static_cast<size_t>(3); }
+
+  size_t CreatePage(const VertexLayout &layout, const size_t vertex_bytes, const size_t index_bytes) {
+    size_t slot = 0;
+    while (slot < pages.size() && pages[slot].vao) slot++;
+    if (slot == pages.size()) pages.emplace_back();
+    Page &page = pages[slot];
+    page = Page();
+    page.layout = layout;
+    page.vertex_capacity = std::max(def_arena_vertex_page_bytes, vertex_bytes) / layout.stride;
+    page.index_capacity = AlignUp(std::max(def_arena_index_page_bytes, index_bytes));
+    page.vertex_free.capacity = page.vertex_capacity;
+    page.vertex_free.Reset(0);
+    page.index_free.capacity = page.index_capacity;
+    page.index_free.Reset(0);
+    glGenVertexArrays(1, &page.vao);
+    CreateBuffers(page);
+    BindBuffers(page);
+    return slot;
+  }
+
+  static void CreateBuffers(Page &page) {
+    glGenBuffers(1, &page.vbo);
+    glGenBuffers(1, &page.ebo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, page.vbo);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(page.vertex_capacity * page.layout.stride), nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, page.ebo);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(page.index_capacity), nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  // points the VAO of page at its buffers; the instance attributes are left alone
+  static void BindBuffers(const Page &page) {
+    GLState::Global().BindVertexArray(page.vao);
+    GLState::Global().BindBuffer(GL_ARRAY_BUFFER, page.vbo);
+    GLState::Global().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.ebo);
+    page.layout.Apply();
+    GLState::Global().BindVertexArray(0);
+  }
+
+  static void DeletePage(Page &page) {
+    GLState::Global().DeleteVertexArrays(1, &page.vao);
+    GLState::Global().DeleteBuffers(1, &page.vbo);
+    GLState::Global().DeleteBuffers(1, &page.ebo);
+    page.vao = page.vbo = page.ebo = 0;
+  }
+
+  // copies the live allocations of a page to the front of fresh buffers, in their current order
+  void CompactPage(const size_t index) {
+    Page &page = pages[index];
+    const GLuint old_vbo = page.vbo, old_ebo = page.ebo;
+    CreateBuffers(page);
+
+    std::vector<Allocation *> live;
+    for (auto &allocation : allocations)
+      if (allocation.live && allocation.page == index) live.push_back(&allocation);
+    std::sort(live.begin(), live.end(), [](const Allocation *a, const Allocation *b) { return a->first_vertex < b->first_vertex; });
+
+    size_t vertex_end = 0, index_end = 0;
+    const size_t stride = page.layout.stride;
+    for (Allocation *allocation : live) {
+      glBindBuffer(GL_COPY_READ_BUFFER, old_vbo);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, page.vbo);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation->first_vertex * stride), static_cast<GLintptr>(vertex_end * stride),
+                          static_cast<GLsizeiptr>(allocation->vertex_count * stride));
+      glBindBuffer(GL_COPY_READ_BUFFER, old_ebo);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, page.ebo);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation->index_offset), static_cast<GLintptr>(index_end),
+                          static_cast<GLsizeiptr>(allocation->index_bytes));
+      allocation->first_vertex = vertex_end;
+      allocation->index_offset = index_end;
+      allocation->range.base_vertex = static_cast<GLint>(vertex_end);
+      allocation->range.index_offset = index_end;
+      vertex_end += allocation->vertex_count;
+      index_end += allocation->index_bytes;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    GLState::Global().DeleteBuffers(1, &old_vbo);
+    GLState::Global().DeleteBuffers(1, &old_ebo);
+    page.vertex_free.Reset(vertex_end);
+    page.index_free.Reset(index_end);
+    BindBuffers(page);
+  }
+};
+#endif
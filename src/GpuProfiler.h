@@ -0,0 +1,161 @@
+#pragma once
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// queries in flight per zone; a zone whose queries are all still pending skips its sample instead of waiting
+constexpr size_t def_gpu_query_latency = 6;
+// samples per zone the averages and percentiles are taken over
+constexpr size_t def_gpu_zone_history = 240;
+
+// GPU time of one zone over its last def_gpu_zone_history samples, in milliseconds
+struct GpuZoneStats {
+  const char *name;
+  size_t samples;
+  double last_ms;
+  double average_ms;
+  double p50_ms;
+  double p95_ms;
+  double max_ms;
+};
+
+// GPU time of named zones, measured with GL_TIME_ELAPSED queries. Each zone owns a ring of query objects, and
+// results are read back only once GL_QUERY_RESULT_AVAILABLE reports them ready, a few frames after they were issued,
+// so profiling never stalls the pipeline. GL runs one time-elapsed query at a time: a zone begun inside another one
+// is not measured on its own and counts toward the outer zone. Zone names must outlive the profiler, string literals
+// are expected. All calls must be made on the thread owning the GL context.
+class GpuProfiler {
+public:
+  static GpuProfiler &Global() {
+    static GpuProfiler profiler;
+    return profiler;
+  }
+
+  // times the enclosing block as zone name
+  class Scope {
+  public:
+    explicit Scope(const char *name) { Global().Begin(name); }
+    ~Scope() { Global().End(); }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+  // reads back every result that is ready. Call once per frame; it never waits for the GPU.
+  void BeginFrame() {
+    for (auto &zone : zones) Collect(zone);
+  }
+
+  void Begin(const char *name) {
+    if (depth++ > 0 || !Supported()) return;
+    Zone &zone = Find(name);
+    if (zone.issued - zone.collected == def_gpu_query_latency) Collect(zone);
+    if (zone.issued - zone.collected == def_gpu_query_latency) {
+      dropped++;
+      return;
+    }
+    if (!zone.queries[0]) glGenQueries(def_gpu_query_latency, zone.queries);
+    glBeginQuery(GL_TIME_ELAPSED, zone.queries[zone.issued % def_gpu_query_latency]);
+    active = &zone;
+  }
+
+  void End() {
+    if (depth == 0 || --depth > 0 || !active) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    active->issued++;
+    active = nullptr;
+  }
+
+  // false when the driver has no timer, zones are then ignored
+  bool Supported() {
+    if (supported < 0) {
+      GLint bits = 0;
+      glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &bits);
+      supported = bits > 0 ? 1 : 0;
+      if (!supported) std::cout << "INFO::GPU_PROFILER:: GL_TIME_ELAPSED has no counter bits, GPU zones are disabled" << std::endl;
+    }
+    return supported > 0;
+  }
+
+  // one entry per zone, in the order the zones were first begun
+  std::vector<GpuZoneStats> Report() const {
+    std::vector<GpuZoneStats> report;
+    std::vector<double> sorted;
+    for (const auto &zone : zones) {
+      GpuZoneStats stats{zone.name, zone.history.size(), 0.0, 0.0, 0.0, 0.0, 0.0};
+      if (!zone.history.empty()) {
+        sorted = zone.history;
+        std::sort(sorted.begin(), sorted.end());
+        for (const double ms : sorted) stats.average_ms += ms;
+        stats.average_ms /= static_cast<double>(sorted.size());
+        stats.last_ms = zone.history[(zone.history_next + zone.history.size() - 1) % zone.history.size()];
+        stats.p50_ms = sorted[(sorted.size() - 1) / 2];
+        stats.p95_ms = sorted[(sorted.size() - 1) * 95 / 100];
+        stats.max_ms = sorted.back();
+      }
+      report.push_back(stats);
+    }
+    return report;
+  }
+
+  // samples skipped because every query of their zone was still in flight
+  size_t Dropped() const { return dropped; }
+
+  // deletes the queries. Call before the context is destroyed.
+  void Clear() {
+    for (auto &zone : zones)
+      if (zone.queries[0]) glDeleteQueries(def_gpu_query_latency, zone.queries);
+    zones.clear();
+    active = nullptr;
+    depth = 0;
+  }
+
+private:
+  struct Zone {
+    const char *name;
+    GLuint queries[def_gpu_query_latency] = {};
+    uint64_t issued = 0;   // queries ended
+    uint64_t collected = 0;// queries read back; the ones in between are in flight
+    std::vector<double> history;
+    size_t history_next = 0;
+  };
+
+  std::vector<Zone> zones;
+  Zone *active = nullptr;
+  size_t depth = 0;
+  size_t dropped = 0;
+  int supported = -1;// unknown until the first zone
+
+  Zone &Find(const char *name) {
+    for (auto &zone : zones)
+      if (zone.name == name || std::strcmp(zone.name, name) == 0) return zone;
+    zones.emplace_back();
+    zones.back().name = name;
+    zones.back().history.reserve(def_gpu_zone_history);
+    return zones.back();
+  }
+
+  // reads the finished queries of zone oldest first, stopping at the first one still pending
+  static void Collect(Zone &zone) {
+    while (zone.collected < zone.issued) {
+      const GLuint query = zone.queries[zone.collected % def_gpu_query_latency];
+      GLint available = GL_FALSE;
+      glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) return;
+      GLuint64 nanoseconds = 0;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+      zone.collected++;
+      const double ms = static_cast<double>(nanoseconds) / 1e6;
+      if (zone.history.size() < def_gpu_zone_history) zone.history.push_back(ms);
+      else zone.history[zone.history_next] = ms;
+      zone.history_next = (zone.history_next + 1) % def_gpu_zone_history;
+    }
+  }
+};
+#endif
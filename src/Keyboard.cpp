@@ -0,0 +1,35 @@
+#include "Keyboard.h"
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <imm.h>
+#define GLFW_EXPOSE_NATIVE_WIN32
+#include <GLFW/glfw3native.h>
+#endif
+
+void Keyboard::Attach(GLFWwindow *window) {
+  glfwSetKeyCallback(window, KeyCallback);
+  glfwSetWindowFocusCallback(window, FocusCallback);
+#ifdef _WIN32
+  // an active IME turns key presses into VK_PROCESSKEY, which GLFW drops. Detaching the IME from this window once
+  // leaves the input language of every other window alone.
+  if (glfwGetPlatform() == GLFW_PLATFORM_WIN32) ImmAssociateContextEx(glfwGetWin32Window(window), nullptr, 0);
+#endif
+}
+
+bool Keyboard::Down(const int key) const {
+  const int scancode = glfwGetKeyScancode(key);
+  return scancode >= 0 && static_cast<size_t>(scancode) < def_scancode_count && held[static_cast<size_t>(scancode)];
+}
+
+void Keyboard::KeyCallback(GLFWwindow *window, const int key, const int scancode, const int action, const int mods) {
+  if (scancode < 0 || static_cast<size_t>(scancode) >= def_scancode_count || action == GLFW_REPEAT) return;
+  Global().held[static_cast<size_t>(scancode)] = action == GLFW_PRESS;
+}
+
+void Keyboard::FocusCallback(GLFWwindow *window, const int focused) { Global().held.reset(); }
@@ -0,0 +1,37 @@
+#pragma once
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#include <bitset>
+#include <cstddef>
+
+struct GLFWwindow;
+
+// scancodes Keyboard tracks; GLFW's are below 512 on every platform
+constexpr size_t def_scancode_count = 512;
+
+// Physical key state of the window, kept by scancode from GLFW's key events. Keys are named by their GLFW token, which
+// stands for the key at that position on a US layout, so bindings hold whatever keyboard layout or input method the
+// user has selected. The platform calls live in Keyboard.cpp so that <windows.h> does not leak into main.cpp.
+class Keyboard {
+public:
+  static Keyboard &Global() {
+    static Keyboard keyboard;
+    return keyboard;
+  }
+
+  // installs the key and focus callbacks on window and keeps the input method editor from swallowing its key events.
+  // Call once, before ImGui installs its callbacks, so that ImGui chains to these.
+  void Attach(GLFWwindow *window);
+
+  // true while the key at the position of the GLFW key token key is held
+  bool Down(int key) const;
+
+private:
+  std::bitset<def_scancode_count> held;
+
+  static void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods);
+  // keys released while another window had focus are never reported, so focus changes forget every key
+  static void FocusCallback(GLFWwindow *window, int focused);
+};
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file.
+// The platform calls live in MappedFile.cpp so that <windows.h> does not leak into every header including this one.
+class MappedFile {
+public:
+  MappedFile() = default;
+
+  explicit MappedFile(const std::string &path) { Open(path); }
+
+  ~MappedFile() { Close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // maps the file at path, closing any previous mapping. Returns false if the file is missing or empty.
+  bool Open(const std::string &path);
+
+  void Close();
+
+  bool IsOpen() const { return data != nullptr; }
+
+  const unsigned char *Data() const { return data; }
+
+  size_t Size() const { return size; }
+
+private:
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+#ifdef _WIN32
+  void *file_handle = nullptr;
+  void *mapping_handle = nullptr;
+#else
+  int file_descriptor = -1;
+#endif
+};
+
+// FNV-1a over a byte range; keys the caches derived from source files. Pass a previous hash to extend it.
+inline uint64_t HashBytes(const unsigned char *bytes, const size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+#endif
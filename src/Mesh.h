@@ -5,7 +5,12 @@
 #include <glad/glad.h>// holds all OpenGL type declarations
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "GLState.h"
+#include "GeometryArena.h"
 #include "Shader.h"
+#include "VertexFormat.h"
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <vector>
 using namespace std;
@@ -35,36 +40,135 @@ struct Texture {
   string path;
 };
 
+// one level of detail: a range of the mesh's index buffer, drawn with the mesh's vertices
+struct MeshLod {
+  uint32_t index_offset;// in indices
+  uint32_t index_count;
+  float error;// geometric deviation from level 0, in model units
+};
+
+// CPU half of a mesh as produced by the importer, before any GL object exists.
+// texture ids are still 0 here; only type and path are known.
+struct MeshData {
+  vector<Vertex> vertices;
+  vector<unsigned int> indices;// all levels of detail, back to back
+  vector<Texture> textures;
+  uint32_t attributes;// vertex_attribute streams the source actually provides
+  vector<MeshLod> lods;// empty = indices is a single level
+};
+
+// GPU-ready streams of a mesh: vertices interleaved in `layout` and 16 or 32 bit indices.
+// the pointers refer either to a PackedMesh or to a mapped mesh cache.
+struct MeshStreams {
+  VertexLayout layout;
+  const void *vertex_data;
+  uint32_t vertex_count;
+  const void *index_data;
+  uint32_t index_count;
+  GLenum index_type;
+  const MeshLod *lods;
+  uint32_t lod_count;
+};
+
+// MeshData converted to its compact vertex layout, see VertexFormat.h.
+struct PackedMesh {
+  VertexLayout layout;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  GLenum index_type;
+  vector<uint8_t> vertex_bytes;
+  vector<uint8_t> index_bytes;
+  vector<Texture> textures;
+  vector<MeshLod> lods;
+
+  // keeps only the streams that data provides and wanted_attributes asks for
+  static PackedMesh Pack(const MeshData &data, const uint32_t wanted_attributes) {
+    PackedMesh packed;
+    packed.layout = VertexLayout::Make(data.attributes & wanted_attributes);
+    packed.vertex_count = static_cast<uint32_t>(data.vertices.size());
+    packed.index_count = static_cast<uint32_t>(data.indices.size());
+    packed.index_type = ChooseIndexType(data.vertices.size());
+    packed.vertex_bytes.resize(data.vertices.size() * packed.layout.stride);
+    for (size_t i = 0; i < data.vertices.size(); i++) PackVertex(data.vertices[i], packed.layout, &packed.vertex_bytes[i * packed.layout.stride]);
+    PackIndices(data.indices, packed.index_type, packed.index_bytes);
+    packed.textures = data.textures;
+    packed.lods = data.lods;
+    if (packed.lods.empty()) packed.lods.push_back(MeshLod{0, packed.index_count, 0.0f});
+    return packed;
+  }
+
+  MeshStreams Streams() const {
+    return MeshStreams{layout, vertex_bytes.data(), vertex_count, index_bytes.data(), index_count, index_type, lods.data(), static_cast<uint32_t>(lods.size())};
+  }
+};
+
 class Mesh {
  public:
+  // one texture of the mesh as seen by the shader it is bound to
+  struct TextureBinding {
+    GLint location;// of the sampler uniform
+    GLint unit;
+    unsigned int texture;
+  };
+
   // mesh Data
-  vector<Vertex> vertices;
-  vector<unsigned int> indices;
   vector<Texture> textures;
-  unsigned int VAO;
-
-  // constructor
-  Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures) {
-    this->vertices = vertices;
-    this->indices = indices;
-    this->textures = textures;
+  GeometryArena::Handle geometry;// vertices and indices, see GeometryArena
+  VertexLayout layout;
+  uint32_t vertex_count;
+  uint32_t index_count;// of all levels of detail
+  GLenum index_type;
+  vector<MeshLod> lods;// level 0 first, each coarser than the previous
+  glm::vec3 bounds_min, bounds_max;// bounding box in model space
+  glm::vec3 bounds_center;         // bounding sphere in model space
+  float bounds_radius;
 
+  // constructor, uploads the streams into the geometry arena; the mesh keeps no CPU copy of them.
+  Mesh(const MeshStreams &streams, vector<Texture> textures)
+    : textures(std::move(textures)), geometry(GeometryArena::def_invalid_handle), layout(streams.layout), vertex_count(streams.vertex_count), index_count(streams.index_count),
+      index_type(streams.index_type), lods(streams.lods, streams.lods + streams.lod_count) {
+    if (lods.empty()) lods.push_back(MeshLod{0, index_count, 0.0f});
+    compute_bounds(streams);
     // now that we have all the required data, set the vertex buffers and its attribute pointers.
-    setup_mesh();
+    setup_mesh(streams);
   }
 
-  // render the mesh
-  void Draw(Shader &shader) {
-    // bind appropriate textures
+  // a mesh owns its arena allocation, so it can be moved but not copied
+  Mesh(Mesh &&other) noexcept
+    : textures(std::move(other.textures)), geometry(other.geometry), layout(other.layout), vertex_count(other.vertex_count), index_count(other.index_count),
+      index_type(other.index_type), lods(std::move(other.lods)), bounds_min(other.bounds_min), bounds_max(other.bounds_max), bounds_center(other.bounds_center),
+      bounds_radius(other.bounds_radius), bindings(std::move(other.bindings)), bound_program(other.bound_program) {
+    other.geometry = GeometryArena::def_invalid_handle;
+  }
+
+  Mesh(const Mesh &) = delete;
+  Mesh &operator=(const Mesh &) = delete;
+  Mesh &operator=(Mesh &&) = delete;
+
+  ~Mesh() { GeometryArena::Global().Free(geometry); }
+
+  // the VAO, base vertex and index offset to draw the mesh with; valid until the arena is compacted
+  const GeometryRange &Geometry() const { return GeometryArena::Global().Range(geometry); }
+
+  // coarsest level whose error stays within max_error model units
+  size_t SelectLod(const float max_error) const {
+    size_t lod = 0;
+    while (lod + 1 < lods.size() && lods[lod + 1].error <= max_error) lod++;
+    return lod;
+  }
+
+  // resolves the sampler each texture feeds in shader (texture_diffuseN, texture_specularN, ...) into the binding
+  // table. Draw does this by itself when the shader changes, so calling it up front only moves the work out of a frame.
+  void Bind(const Shader &shader) {
+    bindings.clear();
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
     unsigned int normalNr = 1;
     unsigned int heightNr = 1;
-    for (unsigned int i = 0; i < textures.size(); i++) {
-      glActiveTexture(GL_TEXTURE0 + i);// active proper texture unit before binding
+    for (const auto &texture : textures) {
       // retrieve texture number (the N in diffuse_textureN)
       string number;
-      string name = textures[i].type;
+      const string &name = texture.type;
       if (name == "texture_diffuse")
         number = std::to_string(diffuseNr++);
       else if (name == "texture_specular")
@@ -74,67 +178,85 @@ class Mesh {
       else if (name == "texture_height")
         number = std::to_string(heightNr++);// transfer unsigned int to string
 
-      // now set the sampler to the correct texture unit
-      glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-      // and finally bind the texture
-      glBindTexture(GL_TEXTURE_2D, textures[i].id);
+      // a texture without a sampler in this shader is never bound
+      const GLint location = shader.location(name + number);
+      if (location >= 0) bindings.push_back(TextureBinding{location, static_cast<GLint>(bindings.size()), texture.id});
     }
+    bound_program = shader.ID;
+  }
+
+  // the textures to bind when drawing with shader, see Bind
+  const vector<TextureBinding> &Bindings(const Shader &shader) {
+    if (bound_program != shader.ID) Bind(shader);
+    return bindings;
+  }
+
+  // render the mesh at the given level of detail. The VAO and textures stay bound; GLState knows about them.
+  void Draw(Shader &shader, const size_t lod = 0) {
+    bind_textures(shader);
 
     // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    const GeometryRange &range = Geometry();
+    GLState::Global().BindVertexArray(range.vao);
+    const MeshLod &level = lods[std::min(lod, lods.size() - 1)];
+    glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(level.index_count), index_type, first_index(range, level), range.base_vertex);
+  }
+
+  // render instance_count copies of the mesh in one draw call. instance_buffer holds one glm::mat4 model matrix per
+  // instance, read at def_instance_matrix_location by the shader (see instanced.vs).
+  void DrawInstanced(Shader &shader, const GLuint instance_buffer, const size_t instance_count, const size_t lod = 0) {
+    if (instance_count == 0) return;
+    bind_textures(shader);
 
-    // always good practice to set everything back to defaults once configured.
-    glActiveTexture(GL_TEXTURE0);
+    const GeometryRange &range = Geometry();
+    GeometryArena::Global().AttachInstances(range.vao, instance_buffer);
+    const MeshLod &level = lods[std::min(lod, lods.size() - 1)];
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(level.index_count), index_type, first_index(range, level), static_cast<GLsizei>(instance_count),
+                                      range.base_vertex);
   }
 
  private:
-  // render data
-  unsigned int VBO, EBO;
-
-  // initializes all the buffer objects/arrays
-  void setup_mesh() {
-    // create buffers/arrays
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    // load data into vertex buffers
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // A great thing about structs is that their memory layout is sequential for all its items.
-    // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-    // again translates to 3/2 floats which translates to a byte array.
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-    // set the vertex attribute pointers
-    // vertex Positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) 0);
-    // vertex normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, Normal));
-    // vertex texture coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, TexCoords));
-    // vertex tangent
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, Tangent));
-    // vertex bitangent
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, Bitangent));
-    // ids
-    glEnableVertexAttribArray(5);
-    glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void *) offsetof(Vertex, m_BoneIDs));
-
-    // weights
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, m_Weights));
-    glBindVertexArray(0);
+  vector<TextureBinding> bindings;
+  unsigned int bound_program = 0;// the shader bindings were resolved for, 0 for none
+
+  const void *first_index(const GeometryRange &range, const MeshLod &level) const {
+    return reinterpret_cast<void *>(range.index_offset + static_cast<size_t>(level.index_offset) * IndexSize(index_type));
+  }
+
+  void bind_textures(const Shader &shader) {
+    if (bound_program != shader.ID) Bind(shader);
+    for (const auto &binding : bindings) {
+      // set the sampler to the correct texture unit
+      glUniform1i(binding.location, binding.unit);
+      // and bind the texture there, unless it already is
+      GLState::Global().BindTexture(static_cast<GLuint>(binding.unit), binding.texture);
+    }
+  }
+
+  void compute_bounds(const MeshStreams &streams) {
+    glm::vec3 low(0.0f), high(0.0f);
+    const auto *bytes = static_cast<const uint8_t *>(streams.vertex_data);
+    for (uint32_t i = 0; i < streams.vertex_count; i++) {
+      glm::vec3 p;
+      std::memcpy(&p, bytes + static_cast<size_t>(i) * streams.layout.stride, sizeof(p));
+      low = i ? glm::min(low, p) : p;
+      high = i ? glm::max(high, p) : p;
+    }
+    bounds_min = low;
+    bounds_max = high;
+    bounds_center = (low + high) * 0.5f;
+    bounds_radius = 0.0f;
+    for (uint32_t i = 0; i < streams.vertex_count; i++) {
+      glm::vec3 p;
+      std::memcpy(&p, bytes + static_cast<size_t>(i) * streams.layout.stride, sizeof(p));
+      bounds_radius = std::max(bounds_radius, glm::length(p - bounds_center));
+    }
+  }
+
+  // copies the streams into the geometry arena
+  void setup_mesh(const MeshStreams &streams) {
+    geometry = GeometryArena::Global().Allocate(streams.layout, streams.vertex_data, streams.vertex_count, streams.index_data,
+                                                static_cast<size_t>(streams.index_count) * IndexSize(streams.index_type));
   }
 };
 #endif
\ No newline at end of file
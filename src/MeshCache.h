@@ -0,0 +1,267 @@
+#pragma once
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "MappedFile.h"
+#include "Mesh.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Binary cache of post-processed meshes, stored next to the source asset as `<asset>.meshcache`.
+// A cache file is only used when it was written for the same source bytes, material library bytes (the .mtl files an
+// OBJ names), import flags and requested vertex streams; bump kMeshCacheVersion whenever the meaning of the stored data
+// changes.
+//
+// layout: MeshCacheHeader, MeshCacheEntry[mesh_count], then per mesh its packed vertices (VertexLayout of the entry's
+// attributes), its 16 or 32 bit indices (all levels of detail), its texture records and its MeshLod table.
+// a texture record is `uint32 type_length, type, uint32 path_length, path`.
+constexpr uint32_t kMeshCacheMagic = 0x4843534D;// "MSCH"
+constexpr uint32_t kMeshCacheVersion = 5;
+
+struct MeshCacheKey {
+  uint64_t source_hash;
+  uint64_t source_size;
+  uint64_t material_hash;
+  uint32_t import_flags;
+  uint32_t vertex_attributes;
+};
+
+struct MeshCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vertex_attributes;
+  uint32_t import_flags;
+  uint64_t source_hash;
+  uint64_t source_size;
+  uint64_t material_hash;
+  uint32_t mesh_count;
+  uint32_t reserved;
+};
+
+struct MeshCacheEntry {
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+  uint64_t texture_offset;
+  uint64_t lod_offset;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint32_t texture_count;
+  uint32_t attributes;
+  uint32_t index_size;
+  uint32_t lod_count;
+};
+
+// a mesh as stored in the cache; the pointers stay valid as long as the MeshCache that produced them is open.
+struct MeshCacheView {
+  MeshStreams streams;
+  vector<Texture> textures;// ids are left at 0, only type and path are stored
+};
+
+class MeshCache {
+public:
+  static string CachePath(const string &source_path) { return source_path + ".meshcache"; }
+
+  // hashes the source asset (FNV-1a over the mapped bytes) and the material libraries it names to key its cache file.
+  static bool MakeKey(const string &source_path, const unsigned int import_flags, const uint32_t vertex_attributes, MeshCacheKey &key) {
+    MappedFile source(source_path);
+    if (!source.IsOpen()) return false;
+    key.source_hash = HashBytes(source.Data(), source.Size());
+    key.source_size = source.Size();
+    key.material_hash = HashMaterialLibraries(source_path, source);
+    key.import_flags = import_flags;
+    key.vertex_attributes = vertex_attributes;
+    return true;
+  }
+
+  // maps the cache file of source_path and validates it against key. On failure the cache stays closed.
+  bool Open(const string &source_path, const MeshCacheKey &key) {
+    entries = nullptr;
+    if (!file.Open(CachePath(source_path))) return false;
+    if (file.Size() < sizeof(MeshCacheHeader)) return Reject();
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file.Data(), sizeof(header));
+    if (header.magic != kMeshCacheMagic || header.version != kMeshCacheVersion) return Reject();
+    if (header.import_flags != key.import_flags || header.vertex_attributes != key.vertex_attributes || header.source_hash != key.source_hash || header.source_size != key.source_size ||
+        header.material_hash != key.material_hash)
+      return Reject();
+    if (file.Size() < sizeof(MeshCacheHeader) + header.mesh_count * sizeof(MeshCacheEntry)) return Reject();
+
+    entries = reinterpret_cast<const MeshCacheEntry *>(file.Data() + sizeof(MeshCacheHeader));
+    mesh_count = header.mesh_count;
+    for (size_t i = 0; i < mesh_count; i++) {
+      const MeshCacheEntry &entry = entries[i];
+      if (entry.index_size != sizeof(uint16_t) && entry.index_size != sizeof(uint32_t)) return Reject();
+      if (entry.vertex_offset + uint64_t(entry.vertex_count) * VertexLayout::Make(entry.attributes).stride > file.Size() ||
+          entry.index_offset + uint64_t(entry.index_count) * entry.index_size > file.Size() ||
+          entry.texture_offset > file.Size() || entry.lod_count == 0 || entry.lod_offset + uint64_t(entry.lod_count) * sizeof(MeshLod) > file.Size())
+        return Reject();
+      const auto *lods = reinterpret_cast<const MeshLod *>(file.Data() + entry.lod_offset);
+      for (uint32_t l = 0; l < entry.lod_count; l++)
+        if (uint64_t(lods[l].index_offset) + lods[l].index_count > entry.index_count) return Reject();
+    }
+    return true;
+  }
+
+  size_t MeshCount() const { return entries ? mesh_count : 0; }
+
+  MeshCacheView GetMesh(const size_t i) const {
+    const MeshCacheEntry &entry = entries[i];
+    MeshCacheView view;
+    view.streams.layout = VertexLayout::Make(entry.attributes);
+    view.streams.vertex_data = file.Data() + entry.vertex_offset;
+    view.streams.vertex_count = entry.vertex_count;
+    view.streams.index_data = file.Data() + entry.index_offset;
+    view.streams.index_count = entry.index_count;
+    view.streams.index_type = entry.index_size == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    view.streams.lods = reinterpret_cast<const MeshLod *>(file.Data() + entry.lod_offset);
+    view.streams.lod_count = entry.lod_count;
+
+    size_t offset = entry.texture_offset;
+    for (uint32_t t = 0; t < entry.texture_count; t++) {
+      Texture texture;
+      texture.id = 0;
+      if (!ReadString(offset, texture.type) || !ReadString(offset, texture.path)) break;
+      view.textures.push_back(texture);
+    }
+    return view;
+  }
+
+  // writes the cache file for source_path. Goes through a temporary file so a crash never leaves a torn cache behind.
+  static bool Write(const string &source_path, const MeshCacheKey &key, const vector<PackedMesh> &meshes) {
+    MeshCacheHeader header{};
+    header.magic = kMeshCacheMagic;
+    header.version = kMeshCacheVersion;
+    header.vertex_attributes = key.vertex_attributes;
+    header.import_flags = key.import_flags;
+    header.source_hash = key.source_hash;
+    header.source_size = key.source_size;
+    header.material_hash = key.material_hash;
+    header.mesh_count = static_cast<uint32_t>(meshes.size());
+
+    vector<MeshCacheEntry> table(meshes.size());
+    uint64_t offset = Align(sizeof(MeshCacheHeader) + table.size() * sizeof(MeshCacheEntry));
+    for (size_t i = 0; i < meshes.size(); i++) {
+      const PackedMesh &mesh = meshes[i];
+      MeshCacheEntry &entry = table[i];
+      entry = MeshCacheEntry{};
+      entry.vertex_count = mesh.vertex_count;
+      entry.index_count = mesh.index_count;
+      entry.texture_count = static_cast<uint32_t>(mesh.textures.size());
+      entry.attributes = mesh.layout.attributes;
+      entry.index_size = static_cast<uint32_t>(IndexSize(mesh.index_type));
+      entry.lod_count = static_cast<uint32_t>(mesh.lods.size());
+      entry.vertex_offset = offset;
+      offset = Align(offset + mesh.vertex_bytes.size());
+      entry.index_offset = offset;
+      offset = Align(offset + mesh.index_bytes.size());
+      entry.texture_offset = offset;
+      for (const Texture &texture : mesh.textures) offset += 2 * sizeof(uint32_t) + texture.type.size() + texture.path.size();
+      offset = Align(offset);
+      entry.lod_offset = offset;
+      offset = Align(offset + mesh.lods.size() * sizeof(MeshLod));
+    }
+
+    const string cache_path = CachePath(source_path);
+    // per-thread temporary name, so concurrent imports of the same asset never write into each other's file
+    const string temp_path = cache_path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+      std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+      if (!out) return false;
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(MeshCacheEntry));
+      for (size_t i = 0; i < meshes.size(); i++) {
+        const PackedMesh &mesh = meshes[i];
+        Pad(out, table[i].vertex_offset);
+        out.write(reinterpret_cast<const char *>(mesh.vertex_bytes.data()), mesh.vertex_bytes.size());
+        Pad(out, table[i].index_offset);
+        out.write(reinterpret_cast<const char *>(mesh.index_bytes.data()), mesh.index_bytes.size());
+        Pad(out, table[i].texture_offset);
+        for (const Texture &texture : mesh.textures) {
+          WriteString(out, texture.type);
+          WriteString(out, texture.path);
+        }
+        Pad(out, table[i].lod_offset);
+        out.write(reinterpret_cast<const char *>(mesh.lods.data()), mesh.lods.size() * sizeof(MeshLod));
+      }
+      if (!out) return false;
+    }
+    std::remove(cache_path.c_str());
+    return std::rename(temp_path.c_str(), cache_path.c_str()) == 0;
+  }
+
+private:
+  MappedFile file;
+  const MeshCacheEntry *entries = nullptr;
+  size_t mesh_count = 0;
+
+  bool Reject() {
+    file.Close();
+    entries = nullptr;
+    return false;
+  }
+
+  bool ReadString(size_t &offset, string &value) const {
+    uint32_t length;
+    if (offset + sizeof(length) > file.Size()) return false;
+    std::memcpy(&length, file.Data() + offset, sizeof(length));
+    offset += sizeof(length);
+    if (offset + length > file.Size()) return false;
+    value.assign(reinterpret_cast<const char *>(file.Data() + offset), length);
+    offset += length;
+    return true;
+  }
+
+  // hashes the .mtl files named by the mtllib lines of an OBJ, so editing a material invalidates the cache. A library
+  // that cannot be opened still changes the hash through its name. 0 for other formats, which embed their materials.
+  static uint64_t HashMaterialLibraries(const string &source_path, const MappedFile &source) {
+    const size_t dot = source_path.find_last_of('.');
+    if (dot == string::npos) return 0;
+    string extension = source_path.substr(dot);
+    for (auto &c : extension) c = static_cast<char>(tolower(c));
+    if (extension != ".obj") return 0;
+
+    const string directory = source_path.substr(0, source_path.find_last_of("/\\") + 1);
+    const char *text = reinterpret_cast<const char *>(source.Data());
+    const char *end = text + source.Size();
+    uint64_t hash = 0;
+    for (const char *p = text; p < end;) {
+      const void *newline = std::memchr(p, '\n', static_cast<size_t>(end - p));
+      const char *line_end = newline ? static_cast<const char *>(newline) : end;
+      while (p < line_end && (*p == ' ' || *p == '\t')) p++;
+      if (line_end - p > 6 && std::memcmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) {
+        // the rest of the line is the library name
+        const char *name = p + 7;
+        const char *name_end = line_end;
+        while (name < name_end && (*name == ' ' || *name == '\t')) name++;
+        while (name_end > name && (name_end[-1] == ' ' || name_end[-1] == '\t' || name_end[-1] == '\r')) name_end--;
+        const string library_path = directory + string(name, name_end);
+        hash = HashBytes(reinterpret_cast<const unsigned char *>(library_path.data()), library_path.size(), hash);
+        MappedFile library(library_path);
+        if (library.IsOpen()) hash = HashBytes(library.Data(), library.Size(), hash);
+      }
+      p = newline ? line_end + 1 : end;
+    }
+    return hash;
+  }
+
+  static uint64_t Align(const uint64_t offset) { return (offset + 15) & ~uint64_t(15); }
+
+  static void Pad(std::ofstream &out, const uint64_t offset) {
+    while (static_cast<uint64_t>(out.tellp()) < offset) out.put('\0');
+  }
+
+  static void WriteString(std::ofstream &out, const string &value) {
+    const auto length = static_cast<uint32_t>(value.size());
+    out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    out.write(value.data(), length);
+  }
+};
+#endif
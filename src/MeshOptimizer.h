@@ -0,0 +1,259 @@
+#pragma once
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Import-time optimization of triangle meshes, run on MeshData before it is packed:
+//  1. weld vertices that are identical in the streams that will be uploaded,
+//  2. order triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm),
+//  3. order clusters of triangles front-to-back from the mesh centre to reduce overdraw, unless that costs cache efficiency,
+//  4. renumber vertices in first-use order for vertex fetch locality.
+
+struct MeshOptimizeStats {
+  size_t vertices_before;
+  size_t vertices_after;
+  float acmr_before;// average cache miss ratio: transformed vertices per triangle, 0.5 is ideal and 3 the worst case
+  float acmr_after;
+};
+
+// FIFO model of the post-transform cache used to measure ACMR
+constexpr size_t def_acmr_cache_size = 16;
+// LRU cache size assumed by the Forsyth scoring
+constexpr size_t def_forsyth_cache_size = 32;
+// overdraw ordering is kept only while it stays within this factor of the cache-optimized ACMR
+constexpr float def_overdraw_threshold = 1.05f;
+
+inline float ComputeAcmr(const vector<unsigned int> &indices, const size_t vertex_count, const size_t cache_size = def_acmr_cache_size) {
+  if (indices.size() < 3) return 0.0f;
+  vector<size_t> cached_at(vertex_count, 0);// time stamp of the vertex entering the cache, 0 = never
+  size_t time = cache_size + 1;
+  size_t misses = 0;
+  for (const unsigned int index : indices) {
+    if (cached_at[index] == 0 || time - cached_at[index] > cache_size) {
+      cached_at[index] = time++;
+      misses++;
+    }
+  }
+  return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+class MeshOptimizer {
+public:
+  // optimizes data in place; `attributes` are the vertex streams that will be kept when packing.
+  static MeshOptimizeStats Optimize(MeshData &data, const uint32_t attributes) {
+    MeshOptimizeStats stats{};
+    stats.vertices_before = data.vertices.size();
+    stats.acmr_before = ComputeAcmr(data.indices, data.vertices.size());
+
+    WeldVertices(data, VertexLayout::Make(data.attributes & attributes));
+    vector<unsigned int> cache_order = OptimizeVertexCache(data.indices, data.vertices.size());
+    vector<unsigned int> overdraw_order = OptimizeOverdraw(data, cache_order);
+    const float cache_acmr = ComputeAcmr(cache_order, data.vertices.size());
+    data.indices = ComputeAcmr(overdraw_order, data.vertices.size()) <= cache_acmr * def_overdraw_threshold ? std::move(overdraw_order) : std::move(cache_order);
+    OptimizeVertexFetch(data);
+
+    stats.vertices_after = data.vertices.size();
+    stats.acmr_after = ComputeAcmr(data.indices, data.vertices.size());
+    return stats;
+  }
+
+  // merges vertices whose packed representation is bit-identical and remaps the indices.
+  static void WeldVertices(MeshData &data, const VertexLayout &layout) {
+    std::unordered_map<string, unsigned int> unique;
+    unique.reserve(data.vertices.size());
+    vector<unsigned int> remap(data.vertices.size());
+    vector<Vertex> welded;
+    welded.reserve(data.vertices.size());
+    string key(layout.stride, '\0');
+    for (size_t i = 0; i < data.vertices.size(); i++) {
+      PackVertex(data.vertices[i], layout, reinterpret_cast<uint8_t *>(&key[0]));
+      auto inserted = unique.emplace(key, static_cast<unsigned int>(welded.size()));
+      if (inserted.second) welded.push_back(data.vertices[i]);
+      remap[i] = inserted.first->second;
+    }
+    for (auto &index : data.indices) index = remap[index];
+    data.vertices.swap(welded);
+  }
+
+  // Tom Forsyth, "Linear-Speed Vertex Cache Optimisation": greedily emits the best scoring triangle, where vertices
+  // score high when they are recently used and have few remaining triangles.
+  static vector<unsigned int> OptimizeVertexCache(const vector<unsigned int> &indices, const size_t vertex_count) {
+    const size_t triangle_count = indices.size() / 3;
+    vector<unsigned int> result;
+    result.reserve(triangle_count * 3);
+    if (triangle_count == 0) return result;
+
+    // vertex -> triangle adjacency
+    vector<unsigned int> offsets(vertex_count + 1, 0);
+    for (const unsigned int index : indices) offsets[index + 1]++;
+    for (size_t v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+    vector<unsigned int> adjacency(indices.size());
+    {
+      vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+      for (size_t t = 0; t < triangle_count; t++)
+        for (int k = 0; k < 3; k++) adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+    }
+
+    vector<unsigned int> remaining(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) remaining[v] = offsets[v + 1] - offsets[v];
+    vector<float> vertex_score(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) vertex_score[v] = VertexScore(-1, remaining[v]);
+    vector<float> triangle_score(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++)
+      triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+    vector<bool> emitted(triangle_count, false);
+
+    vector<unsigned int> cache;
+    vector<unsigned int> next_cache;
+    size_t scan = 0;// next candidate when the cache offers no triangle
+    long long best = -1;
+    for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+      if (best < 0) {
+        // no cached candidate: take the best scoring remaining triangle in input order
+        while (emitted[scan]) scan++;
+        best = static_cast<long long>(scan);
+        for (size_t t = scan; t < triangle_count; t++)
+          if (!emitted[t] && triangle_score[t] > triangle_score[best]) best = static_cast<long long>(t);
+      }
+
+      const auto tri = static_cast<size_t>(best);
+      emitted[tri] = true;
+      next_cache.clear();
+      for (int k = 0; k < 3; k++) {
+        const unsigned int v = indices[tri * 3 + k];
+        result.push_back(v);
+        if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) next_cache.push_back(v);
+        remaining[v]--;
+        // drop the triangle from the vertex's remaining adjacency
+        unsigned int *begin = &adjacency[offsets[v]];
+        unsigned int *end = begin + remaining[v] + 1;
+        std::iter_swap(std::find(begin, end, static_cast<unsigned int>(tri)), end - 1);
+      }
+      const size_t emitted_vertices = next_cache.size();
+      for (const unsigned int v : cache)
+        if (std::find(next_cache.begin(), next_cache.begin() + emitted_vertices, v) == next_cache.begin() + emitted_vertices) next_cache.push_back(v);
+      // vertices pushed out of the cache lose their cache score
+      for (size_t i = def_forsyth_cache_size; i < next_cache.size(); i++) UpdateScore(next_cache[i], -1, offsets, adjacency, remaining, vertex_score, triangle_score);
+      if (next_cache.size() > def_forsyth_cache_size) next_cache.resize(def_forsyth_cache_size);
+      cache.swap(next_cache);
+
+      // rescore the cached vertices and their triangles, and pick the next triangle among them
+      for (size_t i = 0; i < cache.size(); i++) UpdateScore(cache[i], static_cast<int>(i), offsets, adjacency, remaining, vertex_score, triangle_score);
+      best = -1;
+      for (const unsigned int v : cache)
+        for (unsigned int a = offsets[v]; a < offsets[v] + remaining[v]; a++) {
+          const unsigned int t = adjacency[a];
+          if (best < 0 || triangle_score[t] > triangle_score[best]) best = t;
+        }
+    }
+    return result;
+  }
+
+  // splits the cache-ordered triangles into clusters at cache restarts (triangles missing on all three vertices) and
+  // sorts the clusters so the ones facing away from the mesh centre come first.
+  static vector<unsigned int> OptimizeOverdraw(const MeshData &data, const vector<unsigned int> &indices) {
+    const size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) return indices;
+
+    vector<size_t> cluster_starts;
+    {
+      vector<size_t> cached_at(data.vertices.size(), 0);
+      size_t time = def_acmr_cache_size + 1;
+      for (size_t t = 0; t < triangle_count; t++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+          const unsigned int v = indices[t * 3 + k];
+          if (cached_at[v] == 0 || time - cached_at[v] > def_acmr_cache_size) {
+            cached_at[v] = time++;
+            misses++;
+          }
+        }
+        if (t == 0 || misses == 3) cluster_starts.push_back(t);
+      }
+    }
+    cluster_starts.push_back(triangle_count);
+
+    glm::vec3 mesh_centre(0.0f);
+    for (const auto &vertex : data.vertices) mesh_centre += vertex.Position;
+    mesh_centre /= static_cast<float>(std::max<size_t>(data.vertices.size(), 1));
+
+    struct Cluster {
+      size_t begin;
+      size_t end;
+      float sort_key;
+    };
+    vector<Cluster> clusters;
+    for (size_t c = 0; c + 1 < cluster_starts.size(); c++) {
+      glm::vec3 centroid(0.0f);
+      glm::vec3 normal(0.0f);
+      float total_area = 0.0f;
+      for (size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+        const glm::vec3 &a = data.vertices[indices[t * 3]].Position;
+        const glm::vec3 &b = data.vertices[indices[t * 3 + 1]].Position;
+        const glm::vec3 &d = data.vertices[indices[t * 3 + 2]].Position;
+        const glm::vec3 area_normal = glm::cross(b - a, d - a);// length is twice the triangle area
+        const float area = glm::length(area_normal);
+        centroid += (a + b + d) * (area / 3.0f);
+        normal += area_normal;
+        total_area += area;
+      }
+      centroid = total_area > 0.0f ? centroid / total_area : data.vertices[indices[cluster_starts[c] * 3]].Position;
+      const float area = glm::length(normal);
+      const float key = area > 0.0f ? glm::dot(centroid - mesh_centre, normal / area) : 0.0f;
+      clusters.push_back(Cluster{cluster_starts[c], cluster_starts[c + 1], key});
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sort_key > b.sort_key; });
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const auto &cluster : clusters) result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+    return result;
+  }
+
+  // renumbers vertices in order of first use so the vertex fetch walks memory linearly; drops unreferenced vertices.
+  static void OptimizeVertexFetch(MeshData &data) {
+    const auto unused = static_cast<unsigned int>(-1);
+    vector<unsigned int> remap(data.vertices.size(), unused);
+    vector<Vertex> ordered;
+    ordered.reserve(data.vertices.size());
+    for (auto &index : data.indices) {
+      if (remap[index] == unused) {
+        remap[index] = static_cast<unsigned int>(ordered.size());
+        ordered.push_back(data.vertices[index]);
+      }
+      index = remap[index];
+    }
+    data.vertices.swap(ordered);
+  }
+
+private:
+  static void UpdateScore(const unsigned int v, const int cache_position, const vector<unsigned int> &offsets, const vector<unsigned int> &adjacency,
+                          const vector<unsigned int> &remaining, vector<float> &vertex_score, vector<float> &triangle_score) {
+    const float score = VertexScore(cache_position, remaining[v]);
+    const float delta = score - vertex_score[v];
+    vertex_score[v] = score;
+    for (unsigned int a = offsets[v]; a < offsets[v] + remaining[v]; a++) triangle_score[adjacency[a]] += delta;
+  }
+
+  static float VertexScore(const int cache_position, const unsigned int remaining_triangles) {
+    if (remaining_triangles == 0) return -1.0f;
+    float score = 0.0f;
+    if (cache_position >= 0) {
+      // the last triangle's vertices get a fixed score so the algorithm does not favour strips of one triangle
+      if (cache_position < 3) score = 0.75f;
+      else score = std::pow(1.0f - static_cast<float>(cache_position - 3) / static_cast<float>(def_forsyth_cache_size - 3), 1.5f);
+    }
+    // bonus for vertices with few triangles left, so lone triangles are not left behind
+    return score + 2.0f * std::pow(static_cast<float>(remaining_triangles), -0.5f);
+  }
+};
+#endif
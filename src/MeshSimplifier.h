@@ -0,0 +1,227 @@
+#pragma once
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Import-time level-of-detail chains. Every level is an index list into the same vertex buffer, produced by quadric
+// error metric edge collapses (Garland-Heckbert) onto existing vertices. Vertices on open borders and on attribute seams
+// (several vertices at one position) never move, so levels stay crack-free against neighbouring geometry and textures.
+// The levels are appended to MeshData::indices and described by MeshData::lods; level 0 is the input mesh.
+
+// triangle count of each level relative to level 0
+constexpr float def_lod_ratios[] = {0.5f, 0.25f, 0.1f};
+// meshes below this many triangles only get level 0
+constexpr size_t def_lod_min_triangles = 256;
+// a level is dropped unless it has at most this fraction of the triangles of the previous one
+constexpr float def_lod_min_reduction = 0.85f;
+
+class MeshSimplifier {
+public:
+  // builds the levels of data after level 0, which must be data.indices as a whole. Run after MeshOptimizer::Optimize.
+  static void BuildLods(MeshData &data) {
+    const size_t triangle_count = data.indices.size() / 3;
+    data.lods.assign(1, MeshLod{0, static_cast<uint32_t>(data.indices.size()), 0.0f});
+    if (triangle_count < def_lod_min_triangles) return;
+
+    vector<glm::vec3> positions(data.vertices.size());
+    for (size_t i = 0; i < data.vertices.size(); i++) positions[i] = data.vertices[i].Position;
+
+    Simplifier simplifier(positions, data.indices);
+    for (const float ratio : def_lod_ratios) {
+      const auto target = static_cast<size_t>(static_cast<float>(triangle_count) * ratio);
+      if (!simplifier.Reduce(target)) break;
+      const MeshLod &previous = data.lods.back();
+      const size_t level_indices = simplifier.indices.size();
+      if (static_cast<float>(level_indices) > static_cast<float>(previous.index_count) * def_lod_min_reduction) break;
+
+      const vector<unsigned int> level = MeshOptimizer::OptimizeVertexCache(simplifier.indices, data.vertices.size());
+      data.lods.push_back(MeshLod{static_cast<uint32_t>(data.indices.size()), static_cast<uint32_t>(level_indices), simplifier.error});
+      data.indices.insert(data.indices.end(), level.begin(), level.end());
+    }
+  }
+
+private:
+  // symmetric 4x4 error quadric of plane distances, area weighted
+  struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0, weight = 0;
+
+    static Quadric FromPlane(const glm::dvec3 &n, const double d, const double w) {
+      Quadric q;
+      q.a2 = w * n.x * n.x, q.ab = w * n.x * n.y, q.ac = w * n.x * n.z, q.ad = w * n.x * d;
+      q.b2 = w * n.y * n.y, q.bc = w * n.y * n.z, q.bd = w * n.y * d;
+      q.c2 = w * n.z * n.z, q.cd = w * n.z * d, q.d2 = w * d * d;
+      q.weight = w;
+      return q;
+    }
+
+    Quadric &operator+=(const Quadric &o) {
+      a2 += o.a2, ab += o.ab, ac += o.ac, ad += o.ad, b2 += o.b2, bc += o.bc, bd += o.bd, c2 += o.c2, cd += o.cd, d2 += o.d2, weight += o.weight;
+      return *this;
+    }
+
+    // mean squared distance of p to the accumulated planes
+    double Error(const glm::vec3 &p) const {
+      const double x = p.x, y = p.y, z = p.z;
+      const double e = a2 * x * x + b2 * y * y + c2 * z * z + 2 * (ab * x * y + ac * x * z + bc * y * z) + 2 * (ad * x + bd * y + cd * z) + d2;
+      return weight > 0 ? std::max(e / weight, 0.0) : 0.0;
+    }
+  };
+
+  struct Collapse {
+    unsigned int from, to;
+    double cost;
+  };
+
+  // one simplification session; Reduce can be called with decreasing targets to produce successive levels
+  struct Simplifier {
+    const vector<glm::vec3> &positions;
+    vector<unsigned int> indices;
+    vector<Quadric> quadrics;
+    vector<bool> locked;
+    float error = 0.0f;// largest collapse error so far, in model units
+
+    Simplifier(const vector<glm::vec3> &vertex_positions, const vector<unsigned int> &source_indices)
+      : positions(vertex_positions), indices(source_indices), quadrics(vertex_positions.size()), locked(vertex_positions.size(), false) {
+      for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const glm::dvec3 p0 = positions[indices[t]], p1 = positions[indices[t + 1]], p2 = positions[indices[t + 2]];
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        const double area = glm::length(n);
+        if (area <= 0) continue;
+        n /= area;
+        const Quadric q = Quadric::FromPlane(n, -glm::dot(n, p0), area);
+        for (int k = 0; k < 3; k++) quadrics[indices[t + k]] += q;
+      }
+      LockBordersAndSeams();
+    }
+
+    // collapses edges until at most target_triangles remain or nothing can collapse. Returns false if nothing changed.
+    bool Reduce(const size_t target_triangles) {
+      const size_t start = indices.size() / 3;
+      while (indices.size() / 3 > target_triangles) {
+        const size_t before = indices.size();
+        Pass(indices.size() / 3 - target_triangles);
+        if (indices.size() == before) break;
+      }
+      return indices.size() / 3 < start;
+    }
+
+    void LockBordersAndSeams() {
+      // border: an edge used by a single triangle (direction-independent count)
+      std::unordered_map<uint64_t, int> edge_use;
+      edge_use.reserve(indices.size());
+      for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        for (int k = 0; k < 3; k++) edge_use[EdgeKey(indices[t + k], indices[t + (k + 1) % 3])]++;
+      for (const auto &edge : edge_use)
+        if (edge.second == 1) locked[static_cast<unsigned int>(edge.first >> 32)] = locked[static_cast<unsigned int>(edge.first)] = true;
+      // seam: several vertices share a position (split normals or texcoords)
+      std::unordered_map<uint64_t, unsigned int> first_at;
+      first_at.reserve(positions.size());
+      for (unsigned int v = 0; v < positions.size(); v++) {
+        const auto inserted = first_at.emplace(PositionKey(positions[v]), v);
+        if (!inserted.second) locked[v] = locked[inserted.first->second] = true;
+      }
+    }
+
+    static uint64_t EdgeKey(const unsigned int a, const unsigned int b) { return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b); }
+
+    static uint64_t PositionKey(const glm::vec3 &p) {
+      uint32_t bits[3];
+      std::memcpy(bits, &p, sizeof(bits));
+      return (static_cast<uint64_t>(bits[0]) * 0x9E3779B97F4A7C15ull) ^ (static_cast<uint64_t>(bits[1]) * 0xC2B2AE3D27D4EB4Full) ^ (static_cast<uint64_t>(bits[2]) * 0x165667B19E3779F9ull);
+    }
+
+    // one round of independent collapses, cheapest first; every vertex takes part in at most one collapse per round
+    void Pass(const size_t triangles_to_remove) {
+      const size_t vertex_count = positions.size();
+      vector<unsigned int> offsets(vertex_count + 1, 0);
+      for (const unsigned int index : indices) offsets[index + 1]++;
+      for (size_t v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+      vector<unsigned int> adjacency(indices.size());
+      vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+      for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+      vector<Collapse> candidates;
+      candidates.reserve(indices.size());
+      for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+          const unsigned int a = indices[t + k], b = indices[t + (k + 1) % 3];
+          Quadric q = quadrics[a];
+          q += quadrics[b];
+          if (!locked[a]) candidates.push_back(Collapse{a, b, q.Error(positions[b])});
+          if (!locked[b]) candidates.push_back(Collapse{b, a, q.Error(positions[a])});
+        }
+      }
+      std::sort(candidates.begin(), candidates.end(), [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+
+      vector<unsigned int> remap(vertex_count);
+      for (unsigned int v = 0; v < vertex_count; v++) remap[v] = v;
+      vector<bool> touched(vertex_count, false);
+      size_t removed = 0;
+      // the round stops at a cost well above the cheapest, so later rounds see updated quadrics first
+      const double cost_limit = candidates.empty() ? 0.0 : std::max(candidates[candidates.size() / 4].cost * 1.5, candidates.front().cost);
+      for (const Collapse &collapse : candidates) {
+        if (removed >= triangles_to_remove) break;
+        if (collapse.cost > cost_limit && removed > 0) break;
+        if (touched[collapse.from] || touched[collapse.to]) continue;
+        if (FlipsTriangle(collapse, offsets, adjacency)) continue;
+
+        size_t shared = 0;
+        for (unsigned int i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++) {
+          const size_t t = adjacency[i] * 3;
+          if (indices[t] == collapse.to || indices[t + 1] == collapse.to || indices[t + 2] == collapse.to) shared++;
+        }
+        // mark the whole one-ring so collapses of a round never interact
+        for (unsigned int i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++)
+          for (int k = 0; k < 3; k++) touched[indices[adjacency[i] * 3 + k]] = true;
+        for (unsigned int i = offsets[collapse.to]; i < offsets[collapse.to + 1]; i++)
+          for (int k = 0; k < 3; k++) touched[indices[adjacency[i] * 3 + k]] = true;
+
+        remap[collapse.from] = collapse.to;
+        quadrics[collapse.to] += quadrics[collapse.from];
+        error = std::max(error, static_cast<float>(std::sqrt(collapse.cost)));
+        removed += shared;
+      }
+
+      // apply the collapses and drop the triangles that became degenerate
+      size_t write = 0;
+      for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const unsigned int a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+        if (a == b || b == c || a == c) continue;
+        indices[write++] = a;
+        indices[write++] = b;
+        indices[write++] = c;
+      }
+      indices.resize(write);
+    }
+
+    // rejects a collapse that would turn a surviving triangle around the moved vertex over (or make it degenerate)
+    bool FlipsTriangle(const Collapse &collapse, const vector<unsigned int> &offsets, const vector<unsigned int> &adjacency) const {
+      for (unsigned int i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++) {
+        const size_t t = adjacency[i] * 3;
+        const unsigned int v[3] = {indices[t], indices[t + 1], indices[t + 2]};
+        if (v[0] == collapse.to || v[1] == collapse.to || v[2] == collapse.to) continue;
+        glm::vec3 p[3], q[3];
+        for (int k = 0; k < 3; k++) {
+          p[k] = positions[v[k]];
+          q[k] = v[k] == collapse.from ? positions[collapse.to] : p[k];
+        }
+        const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        const glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+        const float before_length = glm::length(before), after_length = glm::length(after);
+        if (after_length <= before_length * 1e-3f) return true;
+        if (glm::dot(before, after) < 0.25f * before_length * after_length) return true;
+      }
+      return false;
+    }
+  };
+};
+#endif
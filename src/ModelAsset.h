@@ -0,0 +1,330 @@
+﻿// ReSharper disable CppClangTidyBugproneNarrowingConversions
+#pragma once
+#ifndef MODEL_ASSET_H
+#define MODEL_ASSET_H
+
+#include <glad/glad.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+
+#include "CpuProfiler.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjReader.h"
+#include "TextureCache.h"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The shareable part of a model: the meshes and textures imported from one file, read-only once uploaded.
+// Instances are handed out by ModelAssetRegistry, so every Model drawing the same file shares one set of GL objects.
+class ModelAsset {
+public:
+  ModelAsset() = default;
+
+  ~ModelAsset() {
+    for (const auto &texture : textures_loaded) TextureCache::Global().Release(texture.id);
+  }
+
+  ModelAsset(const ModelAsset &) = delete;
+  ModelAsset &operator=(const ModelAsset &) = delete;
+
+  // CPU half of loading: file I/O and ASSIMP post-processing into pending mesh data.
+  // touches no GL state, so it may run on any thread.
+  void Import(string const &path) {
+    CpuProfiler::Scope zone("asset import");
+    LoadModel(path);
+  }
+
+  // GL half of loading: creates the buffers and textures of everything Import produced. Must run on the context thread.
+  void Upload() {
+    CpuProfiler::Scope zone("asset upload");
+    if (pending_cache) {
+      for (size_t i = 0; i < pending_cache->MeshCount(); i++) {
+        MeshCacheView view = pending_cache->GetMesh(i);
+        for (auto &texture : view.textures) texture = LoadTexture(texture.path, texture.type);
+        meshes.emplace_back(view.streams, std::move(view.textures));
+      }
+      pending_cache.reset();
+    }
+    for (auto &packed : pending_meshes) {
+      for (auto &texture : packed.textures) texture = LoadTexture(texture.path, texture.type);
+      meshes.emplace_back(packed.Streams(), std::move(packed.textures));
+    }
+    pending_meshes.clear();
+  }
+
+  // model data
+  vector<Texture> textures_loaded;// one entry per reference this model holds in TextureCache, released with the asset
+  vector<Mesh> meshes;
+  string directory;
+  uint32_t vertex_attributes = def_vertex_attributes;// vertex streams to keep at import, see VertexFormat.h
+
+private:
+  // output of Import waiting for Upload: either an open mesh cache or freshly imported meshes
+  std::unique_ptr<MeshCache> pending_cache;
+  vector<PackedMesh> pending_meshes;
+
+  // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in pending_meshes.
+  // plain OBJ files are read by ObjReader, which produces the same mesh data without ASSIMP.
+  // the post-processed and optimized meshes are cached next to the asset, so a warm start maps the cache instead of running ASSIMP.
+  // runs on a loader thread: log lines are built first and written with one call so threads do not interleave them.
+  void LoadModel(string const &path) {
+    // ASSIMP only generates the normals and tangents the asset asks for; tangents are built from the normals
+    unsigned int import_flags = aiProcess_Triangulate | aiProcess_FlipUVs;
+    if (vertex_attributes & (k_vertex_normal | k_vertex_tangent)) import_flags |= aiProcess_GenSmoothNormals;
+    if (vertex_attributes & k_vertex_tangent) import_flags |= aiProcess_CalcTangentSpace;
+    // retrieve the directory path of the filepath
+    directory = path.substr(0, path.find_last_of('/'));
+
+    MeshCacheKey cache_key;
+    const bool cacheable = MeshCache::MakeKey(path, import_flags, vertex_attributes, cache_key);
+    if (cacheable) {
+      std::unique_ptr<MeshCache> cache(new MeshCache());
+      if (cache->Open(path, cache_key)) {
+        pending_cache = std::move(cache);
+        return;
+      }
+    }
+
+    // plain OBJ files take the dedicated reader, everything else (and any OBJ it rejects) goes through ASSIMP
+    const auto import_start = std::chrono::steady_clock::now();
+    vector<MeshData> imported;
+    const bool fast_path = ObjReader::IsObjPath(path) && ObjReader::Read(path, imported, vertex_attributes);
+    if (!fast_path) {
+      imported.clear();
+      // read file via ASSIMP
+      Assimp::Importer importer;
+      const aiScene *scene = importer.ReadFile(path, import_flags);
+      // check for errors
+      if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)// if is Not Zero
+      {
+        std::ostringstream message;
+        message << "ERROR::ASSIMP:: " << importer.GetErrorString() << '\n';
+        cout << message.str();
+        return;
+      }
+      // process ASSIMP's root node recursively
+      ProcessNode(scene->mRootNode, scene, imported);
+    }
+    const std::chrono::duration<double, std::milli> import_time = std::chrono::steady_clock::now() - import_start;
+    std::ostringstream log;
+    log << "INFO::MODEL:: " << path << " imported by " << (fast_path ? "the OBJ reader" : "ASSIMP") << " in " << import_time.count() << " ms\n";
+    // weld and reorder for the vertex cache, build the levels of detail, then convert to the compact per-mesh vertex layouts
+    for (size_t i = 0; i < imported.size(); i++) {
+      const MeshOptimizeStats stats = MeshOptimizer::Optimize(imported[i], vertex_attributes);
+      log << "INFO::MESH_OPTIMIZER:: " << path << " mesh " << i << ": vertices " << stats.vertices_before << " -> " << stats.vertices_after
+          << ", ACMR " << stats.acmr_before << " -> " << stats.acmr_after << '\n';
+      MeshSimplifier::BuildLods(imported[i]);
+      if (imported[i].lods.size() > 1) {
+        log << "INFO::MESH_SIMPLIFIER:: " << path << " mesh " << i << ": triangles";
+        for (const MeshLod &lod : imported[i].lods) log << ' ' << lod.index_count / 3 << " (error " << lod.error << ')';
+        log << '\n';
+      }
+      pending_meshes.push_back(PackedMesh::Pack(imported[i], vertex_attributes));
+    }
+    cout << log.str();
+
+    if (cacheable && !MeshCache::Write(path, cache_key, pending_meshes)) {
+      std::ostringstream message;
+      message << "WARNING::MESH_CACHE:: could not write " << MeshCache::CachePath(path) << '\n';
+      cout << message.str();
+    }
+  }
+
+  // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
+  void ProcessNode(const aiNode *node, const aiScene *scene, vector<MeshData> &imported) {
+    // process each mesh located at the current node
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+      // the node object only contains indices to index the actual objects in the scene.
+      // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+      aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
+      imported.push_back(ProcessMesh(mesh, scene));
+    }
+    // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+    for (unsigned int i = 0; i < node->mNumChildren; i++) { ProcessNode(node->mChildren[i], scene, imported); }
+  }
+
+  MeshData ProcessMesh(aiMesh *mesh, const aiScene *scene) {
+    // data to fill
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Texture> textures;
+
+    // walk through each of the mesh's vertices
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+      Vertex vertex{};
+      glm::vec3 vector;// we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+      // positions
+      vector.x = mesh->mVertices[i].x;
+      vector.y = mesh->mVertices[i].y;
+      vector.z = mesh->mVertices[i].z;
+      vertex.Position = vector;
+      // normals
+      if (mesh->HasNormals()) {
+        vector.x = mesh->mNormals[i].x;
+        vector.y = mesh->mNormals[i].y;
+        vector.z = mesh->mNormals[i].z;
+        vertex.Normal = vector;
+      }
+      // texture coordinates
+      if (mesh->mTextureCoords[0])// does the mesh contain texture coordinates?
+      {
+        glm::vec2 vec;
+        // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
+        // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+        vec.x = mesh->mTextureCoords[0][i].x;
+        vec.y = mesh->mTextureCoords[0][i].y;
+        vertex.TexCoords = vec;
+        if (mesh->HasTangentsAndBitangents()) {
+          // tangent
+          vector.x = mesh->mTangents[i].x;
+          vector.y = mesh->mTangents[i].y;
+          vector.z = mesh->mTangents[i].z;
+          vertex.Tangent = vector;
+          // bi tangent
+          vector.x = mesh->mBitangents[i].x;
+          vector.y = mesh->mBitangents[i].y;
+          vector.z = mesh->mBitangents[i].z;
+          vertex.Bitangent = vector;
+        }
+      } else vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+
+      vertices.push_back(vertex);
+    }
+    // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+      aiFace face = mesh->mFaces[i];
+      // retrieve all indices of the face and store them in the indices vector
+      for (unsigned int j = 0; j < face.mNumIndices; j++) indices.push_back(face.mIndices[j]);
+    }
+    // process materials
+    aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+    // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
+    // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
+    // Same applies to other texture as the following list summarizes:
+    // diffuse: texture_diffuseN
+    // specular: texture_specularN
+    // normal: texture_normalN
+
+    // 1. diffuse maps
+    vector<Texture> diffuseMaps = LoadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+    // 2. specular maps
+    vector<Texture> specularMaps = LoadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+    // 3. normal maps
+    std::vector<Texture> normalMaps = LoadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+    // 4. height maps
+    std::vector<Texture> heightMaps = LoadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+
+    // streams present in the source that the asset asks for; bones are not imported
+    uint32_t attributes = 0;
+    if (mesh->HasNormals()) attributes |= k_vertex_normal;
+    if (mesh->mTextureCoords[0]) attributes |= k_vertex_texcoord;
+    if (mesh->mTextureCoords[0] && mesh->HasTangentsAndBitangents()) attributes |= k_vertex_tangent;
+    attributes &= vertex_attributes;
+
+    // return the extracted mesh data; the GL objects are created later by Upload
+    return MeshData{std::move(vertices), std::move(indices), std::move(textures), attributes, vector<MeshLod>()};
+  }
+
+  // collects all material textures of a given type. Only type and path are filled in here;
+  // Upload requests the textures from TextureStreamer once the mesh reaches the context thread.
+  vector<Texture> LoadMaterialTextures(const aiMaterial *mat, const aiTextureType type, const string &typeName) {
+    vector<Texture> textures;
+    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
+      aiString str;
+      mat->GetTexture(type, i, &str);
+      Texture texture;
+      texture.id = 0;
+      texture.type = typeName;
+      texture.path = str.C_Str();
+      textures.push_back(texture);
+    }
+    return textures;
+  }
+
+  // returns the texture at path (relative to the model directory) from the process-wide TextureCache. The cache streams it in
+  // on first use; the mesh draws with a placeholder until it is resident.
+  Texture LoadTexture(const string &path, const string &typeName) {
+    Texture texture;
+    // colour maps are block-compressed; normal and height maps keep full precision
+    const bool colour = typeName == "texture_diffuse" || typeName == "texture_specular";
+    texture.id = TextureCache::Global().Acquire(directory + '/' + path, colour);
+    texture.type = typeName;
+    texture.path = path;
+    textures_loaded.push_back(texture);
+    return texture;
+  }
+};
+
+// Path-keyed registry of model assets. Assets are reference counted through shared_ptr and released with their last Model;
+// the registry itself only keeps weak references.
+class ModelAssetRegistry {
+public:
+  static ModelAssetRegistry &Global() {
+    static ModelAssetRegistry registry;
+    return registry;
+  }
+
+  // returns the asset for path. created is set when the asset is new and still has to be imported and uploaded by the caller.
+  std::shared_ptr<ModelAsset> Acquire(const string &path, bool &created) {
+    const string key = CanonicalPath(path);// "./resources/axis.obj" and "resources\\axis.obj" name the same asset
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<ModelAsset> asset = assets[key].lock();
+    created = !asset;
+    if (created) {
+      asset = std::make_shared<ModelAsset>();
+      assets[key] = asset;
+      misses++;
+    } else {
+      hits++;
+    }
+    return asset;
+  }
+
+  size_t Hits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+  }
+
+  size_t Misses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+  }
+
+  // number of assets that are still referenced by at least one model
+  size_t LiveCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t live = 0;
+    for (auto it = assets.begin(); it != assets.end();) {
+      if (it->second.expired()) it = assets.erase(it);
+      else {
+        live++;
+        ++it;
+      }
+    }
+    return live;
+  }
+
+private:
+  mutable std::mutex mutex;
+  std::map<string, std::weak_ptr<ModelAsset>> assets;
+  size_t hits = 0;
+  size_t misses = 0;
+};
+#endif
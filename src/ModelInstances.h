@@ -0,0 +1,112 @@
+#pragma once
+#ifndef MODEL_INSTANCES_H
+#define MODEL_INSTANCES_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Model.h"
+#include "RenderQueue.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// Copies of one model asset drawn with hardware instancing: the model matrices of all copies go into one vertex
+// buffer, and every mesh of the asset is drawn once for all of them. Draw with a shader reading the matrix at
+// def_instance_matrix_location, such as instanced.vs. All calls must be made on the thread owning the GL context.
+class ModelInstances {
+public:
+  explicit ModelInstances(std::shared_ptr<ModelAsset> model_asset) : asset(std::move(model_asset)) {}
+
+  ModelInstances(const ModelInstances &) = delete;
+  ModelInstances &operator=(const ModelInstances &) = delete;
+
+  ~ModelInstances() {
+    GeometryArena::Global().DetachInstances(instance_buffer);
+    GLState::Global().DeleteBuffers(1, &instance_buffer);
+  }
+
+  // drops every instance; the buffer is kept for the next frame
+  void Clear() { transforms.clear(); }
+
+  void Add(const glm::mat4 &transform) { transforms.push_back(transform); }
+
+  size_t Count() const { return transforms.size(); }
+
+  // draws every instance at the level of detail the nearest one needs, skipping meshes no instance shows inside
+  // view.frustum, see Model::Draw.
+  // returns the number of triangles submitted.
+  size_t Draw(Shader &shader, const DrawView &view) {
+    if (transforms.empty()) return 0;
+    Upload();
+    size_t triangles = 0;
+    for (auto &mesh : asset->meshes) {
+      if (!Visible(mesh, view)) continue;
+      const size_t lod = SelectLod(mesh, view);
+      mesh.DrawInstanced(shader, instance_buffer, transforms.size(), lod);
+      triangles += mesh.lods[lod].index_count / 3 * transforms.size();
+    }
+    return triangles;
+  }
+
+  // queues one instanced packet per mesh, to be drawn by queue.Flush(). returns the number of triangles queued.
+  size_t Submit(RenderQueue &queue, Shader &shader, const DrawView &view) {
+    if (transforms.empty()) return 0;
+    Upload();
+    size_t triangles = 0;
+    for (auto &mesh : asset->meshes) {
+      if (!Visible(mesh, view)) continue;
+      const size_t lod = SelectLod(mesh, view);
+      queue.SubmitInstanced(shader, mesh, lod, instance_buffer, transforms.size());
+      triangles += mesh.lods[lod].index_count / 3 * transforms.size();
+    }
+    return triangles;
+  }
+
+  std::shared_ptr<ModelAsset> asset;
+
+private:
+  std::vector<glm::mat4> transforms;
+  GLuint instance_buffer = 0;
+  size_t capacity = 0;// instances the buffer has room for
+
+  // a mesh is drawn for all instances as soon as one of them may be seen; it is counted once in view.cull_stats
+  bool Visible(const Mesh &mesh, const DrawView &view) const {
+    if (!view.frustum) return true;
+    DrawView quiet = view;
+    quiet.cull_stats = nullptr;
+    const bool visible = std::any_of(transforms.begin(), transforms.end(), [&](const glm::mat4 &transform) { return quiet.Visible(mesh, transform); });
+    if (view.cull_stats) (visible ? view.cull_stats->visible : view.cull_stats->culled)++;
+    return visible;
+  }
+
+  size_t SelectLod(const Mesh &mesh, const DrawView &view) const {
+    float max_error = std::numeric_limits<float>::max();
+    for (const auto &transform : transforms) {
+      const float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+      const glm::vec3 center = glm::vec3(transform * glm::vec4(mesh.bounds_center, 1.0f));
+      const float distance = std::max(glm::length(center - view.eye) - mesh.bounds_radius * scale, 1e-3f);
+      max_error = std::min(max_error, view.max_error_pixels * distance / (view.projection_scale * scale));
+    }
+    return mesh.SelectLod(max_error);
+  }
+
+  void Upload() {
+    if (!instance_buffer) glGenBuffers(1, &instance_buffer);
+    GLState::Global().BindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    const GLsizeiptr bytes = static_cast<GLsizeiptr>(transforms.size() * sizeof(glm::mat4));
+    if (transforms.size() > capacity) {
+      capacity = transforms.size();
+      glBufferData(GL_ARRAY_BUFFER, bytes, transforms.data(), GL_STREAM_DRAW);
+    } else {
+      // orphan the storage the previous frame's draws may still read
+      glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(glm::mat4)), nullptr, GL_STREAM_DRAW);
+      glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, transforms.data());
+    }
+  }
+};
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include "Model.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads models in parallel. The CPU half (ModelAsset::Import) runs on a pool of worker threads,
+// the GL half (ModelAsset::Upload) is drained by Wait() on the calling thread, which must own the GL context.
+class ModelLoader {
+public:
+  explicit ModelLoader(unsigned int thread_count = std::thread::hardware_concurrency()) {
+    thread_count = std::max(thread_count, 1u);
+    for (unsigned int i = 0; i < thread_count; i++) workers.emplace_back(&ModelLoader::WorkerLoop, this);
+  }
+
+  ~ModelLoader() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    job_ready.notify_all();
+    for (auto &worker : workers) worker.join();
+  }
+
+  ModelLoader(const ModelLoader &) = delete;
+  ModelLoader &operator=(const ModelLoader &) = delete;
+
+  // returns a model for path right away. It has no meshes until Wait() has returned.
+  // the import is only queued when no other model shares the file, see ModelAssetRegistry.
+  std::unique_ptr<Model> Load(const string &model_name, const string &path) {
+    bool created;
+    std::shared_ptr<ModelAsset> asset = ModelAssetRegistry::Global().Acquire(path, created);
+    if (created) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(Job{asset, path});
+        in_flight++;
+      }
+      job_ready.notify_one();
+    }
+    return std::unique_ptr<Model>(new Model(model_name, asset));
+  }
+
+  // uploads every imported model as soon as its worker finishes, until all queued models are resident.
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (in_flight > 0) {
+      job_done.wait(lock, [this] { return !imported.empty(); });
+      std::shared_ptr<ModelAsset> asset = std::move(imported.front());
+      imported.pop_front();
+      lock.unlock();
+      asset->Upload();
+      lock.lock();
+      in_flight--;
+    }
+  }
+
+private:
+  struct Job {
+    std::shared_ptr<ModelAsset> asset;
+    string path;
+  };
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable job_ready;
+  std::condition_variable job_done;
+  std::deque<Job> jobs;
+  std::deque<std::shared_ptr<ModelAsset>> imported;
+  size_t in_flight = 0;
+  bool stopping = false;
+
+  void WorkerLoop() {
+    CpuProfiler::Global().SetThreadName("model loader");
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      job_ready.wait(lock, [this] { return stopping || !jobs.empty(); });
+      if (jobs.empty()) return;
+      Job job = std::move(jobs.front());
+      jobs.pop_front();
+      lock.unlock();
+      job.asset->Import(job.path);
+      lock.lock();
+      imported.push_back(std::move(job.asset));
+      job_done.notify_one();
+    }
+  }
+};
+#endif
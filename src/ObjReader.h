@@ -0,0 +1,479 @@
+#pragma once
+#ifndef OBJ_READER_H
+#define OBJ_READER_H
+
+#include "MappedFile.h"
+#include "Mesh.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Fast path for the plain Wavefront OBJ files we ship. The file is memory-mapped and tokenized in place, split across
+// threads at line boundaries when it is large, and turned into the MeshData that ModelAsset::ProcessMesh produces from
+// ASSIMP with aiProcess_Triangulate | aiProcess_FlipUVs, plus GenSmoothNormals and CalcTangentSpace when the requested
+// attributes include normals or tangents:
+//  - one mesh per object/group and material change, one vertex per face corner,
+//  - quads split like ASSIMP's triangulation (fan from the concave corner, if any),
+//  - normals from the file, or area-independent smooth normals over corners at the same position,
+//  - v flipped, and tangents smoothed over corners at the same position within 45 degrees when texcoords exist.
+// Normals and tangents that were not asked for are neither generated nor flagged.
+// Anything else (polygons with more than 4 corners, lines, points, free-form geometry, faces mixing corners with and
+// without normals or texcoords, materials with texture maps) makes Read return false so the caller can fall back to ASSIMP.
+class ObjReader {
+public:
+  // attributes are the vertex streams wanted, see VertexFormat.h. thread_count caps the threads parsing the file, 0 = one per core
+  static bool Read(const string &path, vector<MeshData> &meshes, const uint32_t attributes, const size_t thread_count = 0) {
+    MappedFile file(path);
+    if (!file.IsOpen()) return false;
+    const char *begin = reinterpret_cast<const char *>(file.Data());
+    const char *end = begin + file.Size();
+
+    // split into chunks of at least def_chunk_size bytes, each ending at a line break
+    const size_t max_threads = thread_count ? thread_count : std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk_count = std::min<size_t>(max_threads, file.Size() / def_chunk_size + 1);
+    vector<const char *> bounds(1, begin);
+    for (size_t i = 1; i < chunk_count; i++) {
+      const char *p = begin + file.Size() * i / chunk_count;
+      if (p < bounds.back()) p = bounds.back();
+      while (p < end && *p != '\n') p++;
+      bounds.push_back(p < end ? p + 1 : end);
+    }
+    bounds.push_back(end);
+    chunk_count = bounds.size() - 1;
+
+    vector<Chunk> chunks(chunk_count);
+    if (chunk_count == 1) ParseChunk(bounds[0], bounds[1], chunks[0]);
+    else {
+      vector<std::thread> threads;
+      for (size_t i = 0; i < chunk_count; i++) threads.emplace_back(&ObjReader::ParseChunk, bounds[i], bounds[i + 1], std::ref(chunks[i]));
+      for (auto &thread : threads) thread.join();
+    }
+    for (const auto &chunk : chunks) {
+      if (!chunk.ok) return false;
+      // textured materials are left to ASSIMP, which imports them
+      for (const auto &library : chunk.material_libraries)
+        if (HasTextureMaps(path.substr(0, path.find_last_of("/\\") + 1) + library)) return false;
+    }
+    return BuildMeshes(chunks, attributes, meshes);
+  }
+
+  static bool IsObjPath(const string &path) {
+    if (path.size() < 4) return false;
+    string extension = path.substr(path.size() - 4);
+    for (auto &c : extension) c = static_cast<char>(tolower(c));
+    return extension == ".obj";
+  }
+
+private:
+  // files below this size are parsed on a single thread
+  static constexpr size_t def_chunk_size = 256 * 1024;
+  // marks a missing texcoord/normal reference of a corner
+  static constexpr int kAbsent = INT_MIN;
+
+  // bits of Corner::relative
+  static constexpr uint8_t kRelativeV = 1, kRelativeVt = 2, kRelativeVn = 4;
+
+  // one face corner as written in the file: a 0-based index, kAbsent when missing. An index whose bit is set in
+  // relative was written as a relative (negative) reference and counts from the start of its chunk; it is negative
+  // when it reaches back into an earlier chunk.
+  struct Corner {
+    int v, vt, vn;
+    uint8_t relative;
+  };
+
+  // mesh boundary before face `face`: a new object/group, or a usemtl naming `material`
+  struct Break {
+    size_t face;
+    bool object;
+    string material;
+  };
+
+  struct Chunk {
+    vector<glm::vec3> positions;
+    vector<glm::vec2> texcoords;
+    vector<glm::vec3> normals;
+    vector<Corner> corners;
+    vector<uint8_t> face_sizes;
+    vector<Break> breaks;
+    vector<string> material_libraries;
+    bool ok = true;
+  };
+
+  static bool IsBlank(const char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+  static const char *SkipBlank(const char *p, const char *end) {
+    while (p < end && IsBlank(*p)) p++;
+    return p;
+  }
+
+  // remainder of the line without surrounding blanks
+  static string Rest(const char *p, const char *line_end) {
+    p = SkipBlank(p, line_end);
+    while (line_end > p && (IsBlank(line_end[-1]) || line_end[-1] == '\n')) line_end--;
+    return string(p, line_end);
+  }
+
+  static bool HasTextureMaps(const string &library_path) {
+    MappedFile library(library_path);
+    if (!library.IsOpen()) return false;
+    const char *text = reinterpret_cast<const char *>(library.Data());
+    const char *end = text + library.Size();
+    for (const char *p = text; p < end; p = NextLine(p, end)) {
+      p = SkipBlank(p, end);
+      if (end - p >= 4 && (std::memcmp(p, "map_", 4) == 0 || std::memcmp(p, "bump", 4) == 0 || std::memcmp(p, "norm", 4) == 0)) return true;
+    }
+    return false;
+  }
+
+  static const char *NextLine(const char *p, const char *end) {
+    const void *newline = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    return newline ? static_cast<const char *>(newline) + 1 : end;
+  }
+
+  static const char *ParseFloat(const char *p, const char *end, float &out) {
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    p = SkipBlank(p, end);
+    const bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    const char *start = p;
+    for (; p < end && static_cast<unsigned>(*p - '0') < 10; p++, digits++) {
+      if (digits < 19) mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+      else exponent++;
+    }
+    if (p < end && *p == '.') {
+      p++;
+      for (; p < end && static_cast<unsigned>(*p - '0') < 10; p++, digits++) {
+        if (digits < 19) {
+          mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+          exponent--;
+        }
+      }
+    }
+    if (p == start || (p == start + 1 && *start == '.')) return nullptr;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      p++;
+      const bool negative_exponent = p < end && *p == '-';
+      if (p < end && (*p == '-' || *p == '+')) p++;
+      int value = 0;
+      for (; p < end && static_cast<unsigned>(*p - '0') < 10; p++) value = std::min(value * 10 + (*p - '0'), 1000);
+      exponent += negative_exponent ? -value : value;
+    }
+    double result = static_cast<double>(mantissa);
+    if (exponent < 0) result = exponent >= -22 ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+    else if (exponent > 0) result = exponent <= 22 ? result * powers[exponent] : result * std::pow(10.0, exponent);
+    out = static_cast<float>(negative ? -result : result);
+    return p;
+  }
+
+  // relative references are turned into chunk-local indices and flagged in relative, see Corner
+  static const char *ParseIndex(const char *p, const char *end, const size_t local_count, int &out, uint8_t &relative, const uint8_t bit) {
+    const bool negative = p < end && *p == '-';
+    if (negative) p++;
+    long long value = 0;
+    const char *start = p;
+    for (; p < end && static_cast<unsigned>(*p - '0') < 10; p++) value = std::min(value * 10 + (*p - '0'), static_cast<long long>(INT_MAX));
+    if (p == start || value == 0) return nullptr;
+    if (!negative) out = static_cast<int>(value - 1);
+    else {
+      out = static_cast<int>(std::max(static_cast<long long>(local_count) - value, -static_cast<long long>(INT_MAX)));
+      relative |= bit;
+    }
+    return p;
+  }
+
+  static void ParseChunk(const char *p, const char *end, Chunk &chunk) {
+    while (p < end) {
+      p = SkipBlank(p, end);
+      const char *line_end = NextLine(p, end);
+      if (p == line_end || *p == '\n' || *p == '#') {
+        p = line_end;
+        continue;
+      }
+      const char *token = p;
+      while (p < line_end && !IsBlank(*p) && *p != '\n') p++;
+      const auto token_length = static_cast<size_t>(p - token);
+      const auto is = [token, token_length](const char *keyword) { return token_length == std::strlen(keyword) && std::memcmp(token, keyword, token_length) == 0; };
+
+      if (is("v") || is("vn")) {
+        glm::vec3 value;
+        if (!(p = ParseFloat(p, line_end, value.x)) || !(p = ParseFloat(p, line_end, value.y)) || !(p = ParseFloat(p, line_end, value.z))) {
+          chunk.ok = false;
+          return;
+        }
+        (is("v") ? chunk.positions : chunk.normals).push_back(value);
+      } else if (is("vt")) {
+        glm::vec2 value;
+        if (!(p = ParseFloat(p, line_end, value.x))) {
+          chunk.ok = false;
+          return;
+        }
+        const char *second = ParseFloat(p, line_end, value.y);
+        if (!second) value.y = 0.0f;
+        chunk.texcoords.push_back(value);
+      } else if (is("f")) {
+        size_t corner_count = 0;
+        for (;;) {
+          p = SkipBlank(p, line_end);
+          if (p >= line_end || *p == '\n') break;
+          Corner corner{kAbsent, kAbsent, kAbsent, 0};
+          if (!(p = ParseIndex(p, line_end, chunk.positions.size(), corner.v, corner.relative, kRelativeV))) {
+            chunk.ok = false;
+            return;
+          }
+          if (p < line_end && *p == '/') {
+            p++;
+            if (p < line_end && *p != '/' && !(p = ParseIndex(p, line_end, chunk.texcoords.size(), corner.vt, corner.relative, kRelativeVt))) {
+              chunk.ok = false;
+              return;
+            }
+            if (p < line_end && *p == '/' && !(p = ParseIndex(p + 1, line_end, chunk.normals.size(), corner.vn, corner.relative, kRelativeVn))) {
+              chunk.ok = false;
+              return;
+            }
+          }
+          chunk.corners.push_back(corner);
+          corner_count++;
+        }
+        if (corner_count < 3 || corner_count > 4) {
+          chunk.ok = false;
+          return;
+        }
+        chunk.face_sizes.push_back(static_cast<uint8_t>(corner_count));
+      } else if (is("o") || is("g")) {
+        chunk.breaks.push_back(Break{chunk.face_sizes.size(), true, string()});
+      } else if (is("usemtl")) {
+        chunk.breaks.push_back(Break{chunk.face_sizes.size(), false, Rest(p, line_end)});
+      } else if (is("mtllib")) {
+        chunk.material_libraries.push_back(Rest(p, line_end));
+      } else if (is("l") || is("p") || is("cstype") || is("curv") || is("curv2") || is("surf") || is("vp")) {
+        chunk.ok = false;
+        return;
+      }
+      // s, mtllib and anything unknown is ignored, as ASSIMP's OBJ loader does for geometry
+      p = line_end;
+    }
+  }
+
+  // resolves a corner reference against the merged element array; -1 when it is out of range
+  static long long Resolve(const int raw, const bool relative, const size_t chunk_base, const size_t total) {
+    const long long index = relative ? static_cast<long long>(chunk_base) + raw : raw;
+    return index >= 0 && index < static_cast<long long>(total) ? index : -1;
+  }
+
+  struct PositionKeyHash {
+    size_t operator()(const glm::vec3 &p) const {
+      uint32_t bits[3];
+      std::memcpy(bits, &p, sizeof(bits));
+      return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+  };
+
+  static bool BuildMeshes(const vector<Chunk> &chunks, const uint32_t attributes, vector<MeshData> &meshes) {
+    // merge the element arrays; relative references only need the base of their own chunk
+    vector<glm::vec3> positions, normals;
+    vector<glm::vec2> texcoords;
+    vector<size_t> position_base, texcoord_base, normal_base;
+    for (const auto &chunk : chunks) {
+      position_base.push_back(positions.size());
+      texcoord_base.push_back(texcoords.size());
+      normal_base.push_back(normals.size());
+      positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+      texcoords.insert(texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+      normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+    }
+
+    // corners of the current mesh; a mesh ends at a new object or a change of material
+    vector<long long> mesh_corners;// triples of (position, texcoord, normal), -1 = absent
+    string material;
+    bool ok = true;
+    const auto flush = [&]() {
+      if (!mesh_corners.empty()) {
+        ok = ok && EmitMesh(mesh_corners, positions, texcoords, normals, attributes, meshes);
+        mesh_corners.clear();
+      }
+    };
+
+    for (size_t c = 0; c < chunks.size(); c++) {
+      const Chunk &chunk = chunks[c];
+      size_t next_break = 0;
+      size_t corner = 0;
+      for (size_t f = 0; f <= chunk.face_sizes.size(); f++) {
+        for (; next_break < chunk.breaks.size() && chunk.breaks[next_break].face == f; next_break++) {
+          const Break &brk = chunk.breaks[next_break];
+          if (brk.object) flush();
+          else if (brk.material != material) {
+            flush();
+            material = brk.material;
+          }
+        }
+        if (f == chunk.face_sizes.size()) break;
+
+        long long face[4][3];
+        const size_t size = chunk.face_sizes[f];
+        for (size_t k = 0; k < size; k++, corner++) {
+          const Corner &raw = chunk.corners[corner];
+          face[k][0] = Resolve(raw.v, (raw.relative & kRelativeV) != 0, position_base[c], positions.size());
+          face[k][1] = raw.vt == kAbsent ? -1 : Resolve(raw.vt, (raw.relative & kRelativeVt) != 0, texcoord_base[c], texcoords.size());
+          face[k][2] = raw.vn == kAbsent ? -1 : Resolve(raw.vn, (raw.relative & kRelativeVn) != 0, normal_base[c], normals.size());
+          if (face[k][0] < 0 || (raw.vt != kAbsent && face[k][1] < 0) || (raw.vn != kAbsent && face[k][2] < 0)) return false;
+        }
+        static const size_t triangle[3] = {0, 1, 2};
+        size_t order[6] = {0, 1, 2, 0, 2, 3};
+        if (size == 4) {
+          // quads can have at most one concave corner; fan from it like ASSIMP's TriangulateProcess
+          size_t start = 0;
+          for (size_t i = 0; i < 4; i++) {
+            const glm::vec3 &v = positions[face[i][0]];
+            const glm::vec3 left = SafeNormalize(positions[face[(i + 3) % 4][0]] - v);
+            const glm::vec3 diag = SafeNormalize(positions[face[(i + 2) % 4][0]] - v);
+            const glm::vec3 right = SafeNormalize(positions[face[(i + 1) % 4][0]] - v);
+            const float angle = std::acos(glm::clamp(glm::dot(left, diag), -1.0f, 1.0f)) + std::acos(glm::clamp(glm::dot(right, diag), -1.0f, 1.0f));
+            if (angle > glm::pi<float>()) {
+              start = i;
+              break;
+            }
+          }
+          const size_t fan[6] = {start, (start + 1) % 4, (start + 2) % 4, start, (start + 2) % 4, (start + 3) % 4};
+          std::copy(fan, fan + 6, order);
+        } else std::copy(triangle, triangle + 3, order);
+        for (size_t k = 0; k < (size == 4 ? 6u : 3u); k++) mesh_corners.insert(mesh_corners.end(), face[order[k]], face[order[k]] + 3);
+      }
+    }
+    flush();
+    return ok;
+  }
+
+  static glm::vec3 SafeNormalize(const glm::vec3 &v) {
+    const float length = glm::length(v);
+    return length > 0.0f ? v / length : glm::vec3(0.0f);
+  }
+
+  static bool EmitMesh(const vector<long long> &corners, const vector<glm::vec3> &positions, const vector<glm::vec2> &texcoords,
+                       const vector<glm::vec3> &normals, const uint32_t attributes, vector<MeshData> &meshes) {
+    const size_t corner_count = corners.size() / 3;
+    size_t with_texcoord = 0, with_normal = 0;
+    for (size_t i = 0; i < corner_count; i++) {
+      with_texcoord += corners[i * 3 + 1] >= 0;
+      with_normal += corners[i * 3 + 2] >= 0;
+    }
+    if ((with_texcoord != 0 && with_texcoord != corner_count) || (with_normal != 0 && with_normal != corner_count)) return false;
+    const bool has_texcoords = with_texcoord != 0;
+    // tangents are built against the normals, so asking for them needs the normals too
+    const bool smooth_normals = !with_normal && (attributes & (k_vertex_normal | k_vertex_tangent)) != 0;
+    const bool tangents = has_texcoords && (attributes & k_vertex_tangent) != 0;
+
+    MeshData data;
+    data.attributes = (k_vertex_normal | (has_texcoords ? k_vertex_texcoord | k_vertex_tangent : 0u)) & attributes;
+    data.vertices.resize(corner_count);
+    data.indices.resize(corner_count);
+    for (size_t i = 0; i < corner_count; i++) {
+      Vertex &vertex = data.vertices[i];
+      vertex = Vertex{};
+      vertex.Position = positions[corners[i * 3]];
+      if (has_texcoords) {
+        const glm::vec2 &uv = texcoords[corners[i * 3 + 1]];
+        vertex.TexCoords = glm::vec2(uv.x, 1.0f - uv.y);
+      }
+      if (with_normal) vertex.Normal = normals[corners[i * 3 + 2]];
+      data.indices[i] = static_cast<unsigned int>(i);
+    }
+
+    // corners sharing a position, in corner order
+    std::unordered_map<glm::vec3, vector<unsigned int>, PositionKeyHash> same_position;
+    if (smooth_normals || tangents) {
+      same_position.reserve(corner_count);
+      for (size_t i = 0; i < corner_count; i++) same_position[data.vertices[i].Position].push_back(static_cast<unsigned int>(i));
+    }
+
+    if (smooth_normals) {
+      // GenSmoothNormals without an angle limit: sum the unit face normals of all corners at the same position
+      vector<glm::vec3> face_normal(corner_count);
+      for (size_t t = 0; t + 2 < corner_count; t += 3) {
+        const glm::vec3 &a = data.vertices[t].Position;
+        const glm::vec3 n = SafeNormalize(glm::cross(data.vertices[t + 1].Position - a, data.vertices[t + 2].Position - a));
+        face_normal[t] = face_normal[t + 1] = face_normal[t + 2] = n;
+      }
+      for (const auto &group : same_position) {
+        glm::vec3 sum(0.0f);
+        for (const unsigned int i : group.second) sum += face_normal[i];
+        sum = SafeNormalize(sum);
+        for (const unsigned int i : group.second) data.vertices[i].Normal = sum;
+      }
+    }
+
+    if (tangents) ComputeTangents(data, same_position);
+
+    meshes.push_back(std::move(data));
+    return true;
+  }
+
+  // CalcTangentSpace: per-face tangents projected onto each corner's normal, then averaged over corners at the same
+  // position whose normals agree and whose tangents and bitangents lie within 45 degrees.
+  static void ComputeTangents(MeshData &data, const std::unordered_map<glm::vec3, vector<unsigned int>, PositionKeyHash> &same_position) {
+    const size_t corner_count = data.vertices.size();
+    for (size_t t = 0; t + 2 < corner_count; t += 3) {
+      Vertex *v = &data.vertices[t];
+      const glm::vec3 edge1 = v[1].Position - v[0].Position;
+      const glm::vec3 edge2 = v[2].Position - v[0].Position;
+      float sx = v[1].TexCoords.x - v[0].TexCoords.x, sy = v[1].TexCoords.y - v[0].TexCoords.y;
+      float tx = v[2].TexCoords.x - v[0].TexCoords.x, ty = v[2].TexCoords.y - v[0].TexCoords.y;
+      const float direction = (tx * sy - ty * sx) < 0.0f ? -1.0f : 1.0f;
+      if (sx * ty == sy * tx) {
+        // degenerate texture mapping: use the default uv directions
+        sx = 0.0f;
+        sy = 1.0f;
+        tx = 1.0f;
+        ty = 0.0f;
+      }
+      const glm::vec3 tangent = (edge2 * sy - edge1 * ty) * direction;
+      const glm::vec3 bitangent = (edge2 * sx - edge1 * tx) * direction;
+      for (int k = 0; k < 3; k++) {
+        const glm::vec3 &n = v[k].Normal;
+        v[k].Tangent = SafeNormalize(tangent - n * glm::dot(tangent, n));
+        v[k].Bitangent = SafeNormalize(bitangent - n * glm::dot(bitangent, n));
+      }
+    }
+
+    const float limit = std::cos(glm::radians(45.0f));
+    vector<bool> done(corner_count, false);
+    vector<unsigned int> found;
+    for (const auto &group : same_position) {
+      for (const unsigned int i : group.second) {
+        if (done[i]) continue;
+        const Vertex &origin = data.vertices[i];
+        found.clear();
+        glm::vec3 tangent(0.0f), bitangent(0.0f);
+        for (const unsigned int j : group.second) {
+          if (done[j]) continue;
+          const Vertex &other = data.vertices[j];
+          if (glm::dot(other.Normal, origin.Normal) < 0.9999f || glm::dot(other.Tangent, origin.Tangent) < limit ||
+              glm::dot(other.Bitangent, origin.Bitangent) < limit)
+            continue;
+          found.push_back(j);
+          tangent += other.Tangent;
+          bitangent += other.Bitangent;
+        }
+        tangent = SafeNormalize(tangent);
+        bitangent = SafeNormalize(bitangent);
+        for (const unsigned int j : found) {
+          data.vertices[j].Tangent = tangent;
+          data.vertices[j].Bitangent = bitangent;
+          done[j] = true;
+        }
+      }
+    }
+  }
+};
+#endif
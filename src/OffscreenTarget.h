@@ -0,0 +1,62 @@
+#pragma once
+#ifndef OFFSCREEN_TARGET_H
+#define OFFSCREEN_TARGET_H
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+
+#include <iostream>
+
+// A framebuffer with a color and a depth renderbuffer, drawn into instead of the default framebuffer when there is
+// no window to present to. All calls must be made on the thread owning the GL context.
+class OffscreenTarget {
+public:
+  OffscreenTarget() = default;
+  OffscreenTarget(const OffscreenTarget &) = delete;
+  OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+  // (re)creates the attachments at the given size. returns false if the framebuffer is incomplete.
+  bool Create(const int width, const int height) {
+    Clear();
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    GLState::Global().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    GLState::Global().BindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      std::cout << "ERROR::FRAMEBUFFER:: offscreen target " << width << 'x' << height << " is not complete: 0x" << std::hex << status << std::dec << '\n';
+      Clear();
+      return false;
+    }
+    target_width = width;
+    target_height = height;
+    return true;
+  }
+
+  // deletes the framebuffer and its attachments. Call before the context is destroyed.
+  void Clear() {
+    if (framebuffer) GLState::Global().DeleteFramebuffers(1, &framebuffer);
+    if (renderbuffers[0]) glDeleteRenderbuffers(2, renderbuffers);
+    framebuffer = renderbuffers[0] = renderbuffers[1] = 0;
+    target_width = target_height = 0;
+  }
+
+  GLuint Framebuffer() const { return framebuffer; }
+  int Width() const { return target_width; }
+  int Height() const { return target_height; }
+
+private:
+  GLuint framebuffer = 0;
+  GLuint renderbuffers[2] = {};// color, depth and stencil
+  int target_width = 0;
+  int target_height = 0;
+};
+#endif
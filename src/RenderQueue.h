@@ -0,0 +1,197 @@
+#pragma once
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "GeometryArena.h"
+#include "Mesh.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// GL work counted by RenderQueue::Flush
+struct RenderStats {
+  size_t draws = 0;  // GL draw calls
+  size_t batched = 0;// packets merged into the multi-draw of a previous packet
+  size_t program_switches = 0;
+  size_t vao_switches = 0;
+  size_t texture_binds = 0;
+};
+
+// one draw call as recorded by RenderQueue::Submit
+struct DrawPacket {
+  uint64_t key;
+  GLuint program;
+  GLuint vao;
+  GLint base_vertex;
+  GLenum index_type;
+  size_t index_offset;// in bytes
+  uint32_t index_count;
+  uint32_t instance_count;// 0 for a plain draw
+  GLuint instance_buffer;
+  uint32_t first_texture; // range of RenderQueue::textures
+  uint32_t texture_count;
+  GLint model_location;// -1 when the program has no model matrix uniform or draws instances
+  glm::mat4 model;
+};
+
+// Deferred draws. Meshes submit packets during the frame; Flush sorts them by a 64-bit key (program, first texture,
+// VAO, then front to back) and issues them, skipping binds that would not change anything. Consecutive packets that
+// differ only in their range of the same arena page are merged into one glMultiDrawElementsBaseVertex. The queue
+// keeps its storage between frames, so a steady scene submits without allocating. All calls must be made on the
+// thread owning the GL context.
+class RenderQueue {
+public:
+  // queues mesh at the given level of detail. model is uploaded to model_uniform when the packet is drawn;
+  // eye orders packets of the same state front to back.
+  void Submit(Shader &shader, Mesh &mesh, const size_t lod, const glm::mat4 &model, const Uniform<glm::mat4> &model_uniform, const glm::vec3 &eye) {
+    const glm::vec3 center = glm::vec3(model * glm::vec4(mesh.bounds_center, 1.0f));
+    Push(shader, mesh, lod, 0, model_uniform.location, model, glm::length(center - eye));
+  }
+
+  // queues instance_count copies of mesh whose model matrices are in instance_buffer, see Mesh::DrawInstanced
+  void SubmitInstanced(Shader &shader, Mesh &mesh, const size_t lod, const GLuint instance_buffer, const size_t instance_count) {
+    if (instance_count == 0) return;
+    Push(shader, mesh, lod, static_cast<uint32_t>(instance_count), -1, glm::mat4(1.0f), 0.0f);
+    packets.back().instance_buffer = instance_buffer;
+  }
+
+  // sorts and draws every queued packet, then empties the queue. Binds go through GLState, so a bind is only
+  // counted when it reached the driver.
+  void Flush() {
+    stats = RenderStats();
+    order.clear();
+    for (uint32_t i = 0; i < packets.size(); i++) order.emplace_back(packets[i].key, i);
+    std::sort(order.begin(), order.end());
+
+    GLState &state = GLState::Global();
+    GLuint program = 0;
+    sampler_units.clear();
+    for (size_t i = 0; i < order.size(); i++) {
+      const DrawPacket &packet = packets[order[i].second];
+      if (packet.program != program) {
+        if (state.UseProgram(packet.program)) stats.program_switches++;
+        program = packet.program;
+        sampler_units.clear();// sampler values belong to the program
+      }
+      for (uint32_t t = packet.first_texture; t < packet.first_texture + packet.texture_count; t++) {
+        const Mesh::TextureBinding &binding = textures[t];
+        SetSampler(binding.location, binding.unit);
+        if (state.BindTexture(static_cast<GLuint>(binding.unit), binding.texture)) stats.texture_binds++;
+      }
+      if (state.BindVertexArray(packet.vao)) stats.vao_switches++;
+      const void *first_index = reinterpret_cast<void *>(packet.index_offset);
+      stats.draws++;
+      if (packet.instance_count > 0) {
+        GeometryArena::Global().AttachInstances(packet.vao, packet.instance_buffer);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(packet.index_count), packet.index_type, first_index,
+                                          static_cast<GLsizei>(packet.instance_count), packet.base_vertex);
+        continue;
+      }
+      if (packet.model_location >= 0) glUniformMatrix4fv(packet.model_location, 1, GL_FALSE, &packet.model[0][0]);
+      // gather the following packets that only differ in their index range and base vertex
+      size_t last = i;
+      while (last + 1 < order.size() && Batchable(packet, packets[order[last + 1].second])) last++;
+      if (last == i) {
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(packet.index_count), packet.index_type, first_index, packet.base_vertex);
+        continue;
+      }
+      batch_counts.clear();
+      batch_indices.clear();
+      batch_base_vertices.clear();
+      for (size_t j = i; j <= last; j++) {
+        const DrawPacket &member = packets[order[j].second];
+        batch_counts.push_back(static_cast<GLsizei>(member.index_count));
+        batch_indices.push_back(reinterpret_cast<void *>(member.index_offset));
+        batch_base_vertices.push_back(member.base_vertex);
+      }
+      glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch_counts.data(), packet.index_type, batch_indices.data(), static_cast<GLsizei>(batch_counts.size()),
+                                    batch_base_vertices.data());
+      stats.batched += last - i;
+      i = last;
+    }
+    packets.clear();
+    textures.clear();
+  }
+
+  size_t Size() const { return packets.size(); }
+
+  // counters of the last Flush
+  const RenderStats &Stats() const { return stats; }
+
+  // sort key: program, first texture, VAO, then the upper bits of the distance (positive floats order like their bits)
+  static uint64_t MakeKey(const GLuint program, const GLuint texture, const GLuint vao, const float distance) {
+    uint32_t distance_bits;
+    const float clamped = std::max(distance, 0.0f);
+    std::memcpy(&distance_bits, &clamped, sizeof(distance_bits));
+    return (static_cast<uint64_t>(program & 0xFFFu) << 52) | (static_cast<uint64_t>(texture & 0xFFFFu) << 36) |
+           (static_cast<uint64_t>(vao & 0xFFFFFu) << 16) | (distance_bits >> 16);
+  }
+
+private:
+  std::vector<DrawPacket> packets;
+  std::vector<Mesh::TextureBinding> textures;
+  std::vector<std::pair<uint64_t, uint32_t>> order;// key, packet
+  std::vector<std::pair<GLint, GLint>> sampler_units;// sampler location, unit set in the current program
+  std::vector<GLsizei> batch_counts;
+  std::vector<const void *> batch_indices;
+  std::vector<GLint> batch_base_vertices;
+  RenderStats stats;
+
+  void Push(Shader &shader, Mesh &mesh, const size_t lod, const uint32_t instance_count, const GLint model_location, const glm::mat4 &model, const float distance) {
+    const auto &bindings = mesh.Bindings(shader);
+    const MeshLod &level = mesh.lods[std::min(lod, mesh.lods.size() - 1)];
+    const GeometryRange &range = mesh.Geometry();
+    DrawPacket packet;
+    packet.key = MakeKey(shader.ID, bindings.empty() ? 0 : bindings.front().texture, range.vao, distance);
+    packet.program = shader.ID;
+    packet.vao = range.vao;
+    packet.base_vertex = range.base_vertex;
+    packet.index_type = mesh.index_type;
+    packet.index_offset = range.index_offset + static_cast<size_t>(level.index_offset) * IndexSize(mesh.index_type);
+    packet.index_count = level.index_count;
+    packet.instance_count = instance_count;
+    packet.instance_buffer = 0;
+    packet.first_texture = static_cast<uint32_t>(textures.size());
+    packet.texture_count = static_cast<uint32_t>(bindings.size());
+    packet.model_location = model_location;
+    packet.model = model;
+    // copied, as drawing the mesh with another program before Flush rebuilds its bindings
+    textures.insert(textures.end(), bindings.begin(), bindings.end());
+    packets.push_back(packet);
+  }
+
+  // b can join the multi-draw of a: same program, VAO, textures, index type and model matrix, and no instancing
+  bool Batchable(const DrawPacket &a, const DrawPacket &b) const {
+    if (b.instance_count > 0 || a.program != b.program || a.vao != b.vao || a.index_type != b.index_type) return false;
+    if (a.model_location != b.model_location || std::memcmp(&a.model, &b.model, sizeof(glm::mat4)) != 0) return false;
+    if (a.texture_count != b.texture_count) return false;
+    for (uint32_t t = 0; t < a.texture_count; t++) {
+      const Mesh::TextureBinding &x = textures[a.first_texture + t], &y = textures[b.first_texture + t];
+      if (x.location != y.location || x.unit != y.unit || x.texture != y.texture) return false;
+    }
+    return true;
+  }
+
+  void SetSampler(const GLint location, const GLint unit) {
+    for (auto &sampler : sampler_units) {
+      if (sampler.first != location) continue;
+      if (sampler.second != unit) {
+        glUniform1i(location, unit);
+        sampler.second = unit;
+      }
+      return;
+    }
+    glUniform1i(location, unit);
+    sampler_units.emplace_back(location, unit);
+  }
+};
+#endif
@@ -4,10 +4,35 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "FrameConstants.h"
+#include "GLState.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+
+// typed handle of an active uniform, resolved once with Shader::uniform and reused for every set call.
+// an invalid handle (location -1) is ignored by GL, like a name that is not in the program.
+template <typename T>
+struct Uniform
+{
+    GLint location = -1;
+    bool valid() const { return location >= 0; }
+};
+
+// GL type of the uniforms a Uniform<T> may refer to
+template <typename T> struct UniformType;
+template <> struct UniformType<bool> { static bool matches(GLenum type) { return type == GL_BOOL || type == GL_INT; } };
+template <> struct UniformType<int> { static bool matches(GLenum type) { return type == GL_INT || type == GL_BOOL || (type >= GL_SAMPLER_1D && type <= GL_SAMPLER_2D_RECT_SHADOW) || (type >= GL_SAMPLER_1D_ARRAY && type <= GL_UNSIGNED_INT_SAMPLER_BUFFER); } };
+template <> struct UniformType<float> { static bool matches(GLenum type) { return type == GL_FLOAT; } };
+template <> struct UniformType<glm::vec2> { static bool matches(GLenum type) { return type == GL_FLOAT_VEC2; } };
+template <> struct UniformType<glm::vec3> { static bool matches(GLenum type) { return type == GL_FLOAT_VEC3; } };
+template <> struct UniformType<glm::vec4> { static bool matches(GLenum type) { return type == GL_FLOAT_VEC4; } };
+template <> struct UniformType<glm::mat2> { static bool matches(GLenum type) { return type == GL_FLOAT_MAT2; } };
+template <> struct UniformType<glm::mat3> { static bool matches(GLenum type) { return type == GL_FLOAT_MAT3; } };
+template <> struct UniformType<glm::mat4> { static bool matches(GLenum type) { return type == GL_FLOAT_MAT4; } };
 
 class Shader
 {
@@ -68,74 +93,147 @@ public:
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
-
+        reflectUniforms();
+        // programs declaring the per-frame block read it from the shared buffer, see FrameConstantsBuffer
+        const GLuint frameBlock = glGetUniformBlockIndex(ID, def_frame_constants_block);
+        if (frameBlock != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, frameBlock, def_frame_constants_binding);
+    }
+    // typed handle of the active uniform `name`; invalid if the program has no such uniform or its type differs from T.
+    // resolve handles once (after construction) and keep them: the set calls taking a handle do no lookup at all.
+    // ------------------------------------------------------------------------
+    template <typename T>
+    Uniform<T> uniform(const std::string &name) const
+    {
+        Uniform<T> handle;
+        const auto it = uniforms.find(name);
+        if (it == uniforms.end())
+            return handle;
+        if (!UniformType<T>::matches(it->second.type))
+        {
+            std::cout << "WARNING::SHADER:: uniform " << name << " has a different type than requested" << std::endl;
+            return handle;
+        }
+        handle.location = it->second.location;
+        return handle;
+    }
+    // location of the active uniform `name` from the table reflected at link time, -1 if there is none
+    GLint location(const std::string &name) const
+    {
+        const auto it = uniforms.find(name);
+        return it == uniforms.end() ? -1 : it->second.location;
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     { 
-        glUseProgram(ID); 
+        GLState::Global().UseProgram(ID);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(location(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(location(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(location(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(location(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(location(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(location(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
+    // ------------------------------------------------------------------------
+    void set(const Uniform<bool> &u, bool value) const { glUniform1i(u.location, (int)value); }
+    void set(const Uniform<int> &u, int value) const { glUniform1i(u.location, value); }
+    void set(const Uniform<float> &u, float value) const { glUniform1f(u.location, value); }
+    void set(const Uniform<glm::vec2> &u, const glm::vec2 &value) const { glUniform2fv(u.location, 1, &value[0]); }
+    void set(const Uniform<glm::vec3> &u, const glm::vec3 &value) const { glUniform3fv(u.location, 1, &value[0]); }
+    void set(const Uniform<glm::vec4> &u, const glm::vec4 &value) const { glUniform4fv(u.location, 1, &value[0]); }
+    void set(const Uniform<glm::mat2> &u, const glm::mat2 &mat) const { glUniformMatrix2fv(u.location, 1, GL_FALSE, &mat[0][0]); }
+    void set(const Uniform<glm::mat3> &u, const glm::mat3 &mat) const { glUniformMatrix3fv(u.location, 1, GL_FALSE, &mat[0][0]); }
+    void set(const Uniform<glm::mat4> &u, const glm::mat4 &mat) const { glUniformMatrix4fv(u.location, 1, GL_FALSE, &mat[0][0]); }
+
 private:
+    struct UniformInfo
+    {
+        GLint location;
+        GLenum type;
+    };
+    // active uniforms outside uniform blocks, by name; arrays are listed both as "name" and "name[0]"
+    std::unordered_map<std::string, UniformInfo> uniforms;
+
+    // fills the uniform table from the linked program
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        GLint count = 0, max_length = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+        std::string name(static_cast<size_t>(max_length > 0 ? max_length : 1), '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, static_cast<GLuint>(i), max_length, &length, &size, &type, &name[0]);
+            const std::string uniform_name(name.data(), static_cast<size_t>(length));
+            const GLint uniform_location = glGetUniformLocation(ID, uniform_name.c_str());
+            if (uniform_location < 0)
+                continue; // member of a uniform block
+            uniforms[uniform_name] = UniformInfo{uniform_location, type};
+            const size_t bracket = uniform_name.find('[');
+            if (bracket != std::string::npos)
+                uniforms[uniform_name.substr(0, bracket)] = UniformInfo{uniform_location, type};
+            else if (size > 1)
+                uniforms[uniform_name + "[0]"] = UniformInfo{uniform_location, type};
+        }
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
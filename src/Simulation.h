@@ -0,0 +1,224 @@
+#pragma once
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "CpuProfiler.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+// steps per second when none is given
+constexpr double def_sim_rate_hz = 500.0;
+// the last part of the wait for a step is spun instead of slept, sleeps overshoot by a scheduler tick
+constexpr double def_sim_spin_seconds = 0.002;
+// steps the simulation may fall behind before it gives up catching up
+constexpr int def_sim_max_late_steps = 10;
+// tool speeds, per second; the keys used to move the tools 0.5 units and 1 degree per frame at 60 Hz
+constexpr float def_dynamic_speed = 30.0f;
+constexpr float def_roll_speed = 60.0f;// degrees
+constexpr float def_advance_speed = 40.0f;
+
+// the pose of one instrument as Model stores it: position and XYZ Euler angles in degrees
+struct ToolPose {
+  glm::vec3 position;
+  glm::vec3 rotation;
+};
+
+// edits made in the debug panel, counted per field. An edit is applied by the first step that sees its count change,
+// so none is lost however many frames or steps pass in between.
+struct SimEdits {
+  uint32_t ani_value = 0;
+  uint32_t dynamic_pos = 0;
+  uint32_t endoscope = 0;
+};
+
+// everything the simulation owns, handed to the render thread whole after every step. The render thread copies it into
+// the models it draws.
+struct SimState {
+  ToolPose tube;
+  ToolPose endoscope;
+  ToolPose upper;// rongeur jaws
+  ToolPose lower;
+  glm::vec3 pivot_pos;
+  glm::vec3 dynamic_pos;
+  float ani_value = 0.0f;
+  uint64_t tick = 0;// steps taken
+  SimEdits edits;   // edits applied so far
+};
+
+// the controls held and the edits made on the render thread, see Simulation::Post.
+// directions are -1, 0 or 1; advances move a tool along the pivot axis, away from the pivot when positive.
+struct SimInput {
+  glm::vec3 dynamic_move{0.0f};
+  float tube_roll = 0.0f;
+  float rongeur_roll = 0.0f;
+  float tube_advance = 0.0f;
+  float endoscope_advance = 0.0f;
+  float rongeur_advance = 0.0f;
+  // the latest value of each edit; bump its count in edits when changing it
+  float ani_value = 0.0f;
+  glm::vec3 dynamic_pos{0.0f};
+  ToolPose endoscope{};
+  SimEdits edits;
+};
+
+// direction of the local z axis of a tool with the given Euler angles
+inline glm::vec3 GetCurrentModelZAxis(const glm::vec3 &rotation) {
+  auto rot_matrix = glm::mat4(1.0f);
+  rot_matrix = glm::rotate(rot_matrix, glm::radians(rotation.x), glm::vec3(1, 0, 0));
+  rot_matrix = glm::rotate(rot_matrix, glm::radians(rotation.y), glm::vec3(0, 1, 0));
+  rot_matrix = glm::rotate(rot_matrix, glm::radians(rotation.z), glm::vec3(0, 0, 1));
+
+  const auto z_axis_local = glm::vec4(0, 0, 1, 0);
+  const glm::vec3 z_axis_world = rot_matrix * z_axis_local;
+  return glm::normalize(z_axis_world);
+}
+
+// Tool kinematics stepped at a fixed rate on a thread of its own, so the poses and their publishing keep their rate
+// however long a frame takes to render. The render thread posts input with Post and draws the state Snapshot returns;
+// the publish function runs on the simulation thread after every step. Input and state cross threads through triple
+// buffers, so neither thread ever waits for the other. The state has a single reader: Post and Snapshot must be called
+// from one thread, the render thread, and debug builds assert it. Anything else that needs every state, such as a
+// recorder, takes it from the publish function rather than from Snapshot.
+class Simulation {
+public:
+  using PublishFunction = std::function<void(const SimState &)>;
+
+  Simulation() = default;
+  Simulation(const Simulation &) = delete;
+  Simulation &operator=(const Simulation &) = delete;
+
+  ~Simulation() { Stop(); }
+
+  void Start(const SimState &initial, const double rate_hz, PublishFunction publish_function) {
+    Stop();
+    states.Reset(initial);
+    inputs.Reset(SimInput());
+    rate = rate_hz > 0.0 ? rate_hz : def_sim_rate_hz;
+    publish = std::move(publish_function);
+    stopping = false;
+    thread = std::thread(&Simulation::Run, this);
+  }
+
+  // finishes the current step and joins the thread. Call before anything the publish function uses goes away.
+  void Stop() {
+    stopping = true;
+    if (thread.joinable()) thread.join();
+  }
+
+  // replaces the input the next steps read
+  void Post(const SimInput &posted) {
+    inputs.Back() = posted;
+    inputs.Publish();
+  }
+
+  // the state after the latest step; stays valid and unchanged until the next call
+  const SimState &Snapshot() {
+    states.Update();
+    return states.Front();
+  }
+
+  double Rate() const { return rate; }
+
+  // steps that started later than their slot
+  uint64_t LateSteps() const { return late_steps.load(std::memory_order_relaxed); }
+
+  // advances state by dt seconds of input
+  static void Step(SimState &state, const SimInput &input, const float dt) {
+    if (input.edits.ani_value != state.edits.ani_value) state.ani_value = input.ani_value;
+    if (input.edits.dynamic_pos != state.edits.dynamic_pos) state.dynamic_pos = input.dynamic_pos;
+    if (input.edits.endoscope != state.edits.endoscope) state.endoscope = input.endoscope;
+    state.edits = input.edits;
+    state.dynamic_pos += input.dynamic_move * (def_dynamic_speed * dt);
+    state.tube.rotation.z += input.tube_roll * def_roll_speed * dt;
+    state.upper.rotation.z += input.rongeur_roll * def_roll_speed * dt;
+    state.lower.rotation.z += input.rongeur_roll * def_roll_speed * dt;
+    Align(state.tube, state.pivot_pos, state.dynamic_pos, input.tube_advance * def_advance_speed * dt);
+    Align(state.endoscope, state.pivot_pos, state.dynamic_pos, input.endoscope_advance * def_advance_speed * dt);
+    Align(state.upper, state.pivot_pos, state.dynamic_pos, input.rongeur_advance * def_advance_speed * dt);
+    Align(state.lower, state.pivot_pos, state.dynamic_pos, input.rongeur_advance * def_advance_speed * dt);
+    state.tick++;
+  }
+
+  // turns tool onto the axis from dynamic_pos to pivot_pos, keeping its distance to the pivot, then moves it advance
+  // units along that axis
+  static void Align(ToolPose &tool, const glm::vec3 &pivot_pos, const glm::vec3 &dynamic_pos, const float advance) {
+    const glm::vec3 current_dir = GetCurrentModelZAxis(tool.rotation);
+    const glm::vec3 target_dir = glm::normalize(pivot_pos - dynamic_pos);
+
+    // Calculates the quaternion of rotation between two directions
+    const float dir_threshold = 0.001f;// Small threshold angle in radians
+    const float dot_product = glm::dot(current_dir, target_dir);
+    float angle = std::acos(glm::clamp(dot_product, -1.0f, 1.0f));
+
+    if (std::abs(angle) < dir_threshold) { angle = 0.0f; }
+    if (angle > 0.0f) {
+      glm::vec3 rotation_axis = glm::cross(current_dir, target_dir);
+
+      if (glm::length(rotation_axis) < 0.001f) {
+        // If the current direction and the target direction are almost parallel
+        rotation_axis = glm::vec3(0.0f, 0.0f, 1.0f);// can choose any axis perpendicular to these directions
+      } else { rotation_axis = glm::normalize(rotation_axis); }
+
+      const glm::quat rotation_quat = glm::angleAxis(angle, glm::normalize(rotation_axis));
+      const auto current_quat = glm::quat(glm::radians(tool.rotation));
+      const glm::quat new_quat = rotation_quat * current_quat;
+
+      // Build a quaternion rotation
+      tool.rotation = glm::degrees(glm::eulerAngles(new_quat));
+    }
+    const glm::vec3 position = tool.position + target_dir * advance;
+    const float distance_to_pivot = glm::length(pivot_pos - position);
+    tool.position = pivot_pos - target_dir * distance_to_pivot;
+  }
+
+private:
+  TripleBuffer<SimState> states;// written by the simulation thread
+  TripleBuffer<SimInput> inputs;// written by Post
+  double rate = def_sim_rate_hz;
+  PublishFunction publish;
+  std::thread thread;
+  std::atomic<bool> stopping{false};
+  std::atomic<uint64_t> late_steps{0};
+
+  void Run() {
+    CpuProfiler::Global().SetThreadName("simulation");
+    using clock = std::chrono::steady_clock;
+    const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / rate));
+    const auto spin = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(def_sim_spin_seconds));
+    const float dt = static_cast<float>(1.0 / rate);
+    SimState current = states.Back();
+    auto next = clock::now();
+    while (!stopping.load(std::memory_order_relaxed)) {
+      inputs.Update();
+      {
+        CpuProfiler::Scope zone("kinematics");
+        Step(current, inputs.Front(), dt);
+      }
+      states.Back() = current;
+      states.Publish();
+      if (publish) publish(current);
+
+      next += period;
+      const auto now = clock::now();
+      if (now > next) {
+        late_steps.fetch_add(1, std::memory_order_relaxed);
+        // too far behind to catch up: drop the missed steps rather than run them back to back
+        if (now - next > period * def_sim_max_late_steps) next = now;
+        continue;
+      }
+      if (next - now > spin) std::this_thread::sleep_for(next - now - spin);
+      while (clock::now() < next) std::this_thread::yield();
+    }
+  }
+};
+#endif
@@ -0,0 +1,67 @@
+#include "TextureBaker.h"
+
+#include <cctype>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+bool IsImagePath(const std::string &path) {
+  const size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos) return false;
+  std::string extension = path.substr(dot + 1);
+  for (auto &c : extension) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  return extension == "png" || extension == "jpg" || extension == "jpeg";
+}
+
+// appends the paths of all files below directory
+void ListFiles(const std::string &directory, std::vector<std::string> &files) {
+#ifdef _WIN32
+  WIN32_FIND_DATAA entry;
+  HANDLE find = FindFirstFileA((directory + "/*").c_str(), &entry);
+  if (find == INVALID_HANDLE_VALUE) return;
+  do {
+    const std::string name = entry.cFileName;
+    if (name == "." || name == "..") continue;
+    if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ListFiles(directory + '/' + name, files);
+    else files.push_back(directory + '/' + name);
+  } while (FindNextFileA(find, &entry));
+  FindClose(find);
+#else
+  DIR *dir = opendir(directory.c_str());
+  if (!dir) return;
+  while (const dirent *entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    if (name == "." || name == "..") continue;
+    const std::string path = directory + '/' + name;
+    struct stat status {};
+    if (stat(path.c_str(), &status) != 0) continue;
+    if (S_ISDIR(status.st_mode)) ListFiles(path, files);
+    else if (S_ISREG(status.st_mode)) files.push_back(path);
+  }
+  closedir(dir);
+#endif
+}
+
+}// namespace
+
+size_t TextureBaker::BakeDirectory(const std::string &root) {
+  std::vector<std::string> files;
+  ListFiles(root, files);
+  size_t baked = 0;
+  BakedTexture texture;
+  for (const auto &file : files) {
+    if (!IsImagePath(file)) continue;
+    if (Load(file, true, def_texture_flip, texture) && Load(file, false, def_texture_flip, texture)) baked++;
+    else std::cout << "WARNING::TEXTURE_BAKER:: could not bake " << file << '\n';
+  }
+  return baked;
+}
@@ -0,0 +1,304 @@
+#pragma once
+#ifndef TEXTURE_BAKER_H
+#define TEXTURE_BAKER_H
+
+#include <glad/glad.h>
+#include "stb_image.h"
+
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// S3TC formats (EXT_texture_compression_s3tc); not part of the GL 3.3 core header
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Baked textures, stored next to the source image: the full mip chain, box filtered, either block-compressed (BC1 for
+// opaque colour maps, BC3 when there is alpha) as `<image>.texcache`, or as plain RGBA8 (data maps such as normal maps,
+// or drivers without S3TC) as `<image>.rgba.texcache`. A bake is reused while the source bytes, the compression and the
+// row order match; bump kBakedTextureVersion whenever the encoding changes.
+//
+// layout: BakedTextureHeader, BakedTextureLevel[level_count], then the level data, each level 16-byte aligned.
+constexpr uint32_t kBakedTextureMagic = 0x48435854;// "TXCH"
+constexpr uint32_t kBakedTextureVersion = 1;
+
+// images are stored bottom row first, the order glTexImage2D expects for the texcoords the importer produces
+constexpr bool def_texture_flip = true;
+
+struct BakedTextureHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t source_hash;
+  uint64_t source_size;
+  uint32_t format;// GL internal format
+  uint32_t width;
+  uint32_t height;
+  uint32_t level_count;
+  uint32_t compress;// compression was requested
+  uint32_t flip;    // rows were flipped at decode
+};
+
+struct BakedTextureLevel {
+  uint64_t offset;// from the start of the level data
+  uint64_t size;
+  uint32_t width;
+  uint32_t height;
+};
+
+// a baked texture ready for upload
+struct BakedTexture {
+  GLenum format = GL_RGBA;
+  std::vector<BakedTextureLevel> levels;
+  std::vector<uint8_t> data;
+
+  bool Compressed() const { return format != GL_RGBA; }
+};
+
+class TextureBaker {
+public:
+  // the compressed and the RGBA8 bake live side by side, the same image may be asked for both ways
+  static std::string CachePath(const std::string &source_path, const bool compress) { return source_path + (compress ? ".texcache" : ".rgba.texcache"); }
+
+  // loads the bake of source_path, baking it (and writing the cache file) first when there is no valid one.
+  // compress selects BC1/BC3 over RGBA8, flip stores the image bottom row first. Touches no GL state.
+  static bool Load(const std::string &source_path, const bool compress, const bool flip, BakedTexture &texture) {
+    MappedFile source(source_path);
+    if (!source.IsOpen()) return false;
+    const uint64_t source_hash = HashBytes(source.Data(), source.Size());
+    if (ReadCache(source_path, source_hash, source.Size(), compress, flip, texture)) return true;
+
+    int width, height, components;
+    // per thread, so the decode never depends on what anyone set stb_image's global flag to
+    stbi_set_flip_vertically_on_load_thread(flip);
+    unsigned char *pixels = stbi_load_from_memory(source.Data(), static_cast<int>(source.Size()), &width, &height, &components, 4);
+    if (!pixels) return false;
+    Bake(pixels, width, height, compress, texture);
+    stbi_image_free(pixels);
+    WriteCache(source_path, source_hash, source.Size(), compress, flip, texture);
+    return true;
+  }
+
+  // bakes both variants of every PNG and JPG below root that has no valid bake yet, with def_texture_flip like the
+  // runtime loads. Which variant an image needs depends on the material using it, so neither is left to startup.
+  // Returns the number of images whose bakes are now valid. Defined in TextureBaker.cpp, which holds the directory walk.
+  static size_t BakeDirectory(const std::string &root);
+
+  // builds the mip chain of an RGBA8 image and encodes every level.
+  static void Bake(const unsigned char *pixels, const int width, const int height, const bool compress, BakedTexture &texture) {
+    texture.levels.clear();
+    texture.data.clear();
+    bool opaque = true;
+    for (size_t i = 3; i < static_cast<size_t>(width) * height * 4; i += 4) opaque = opaque && pixels[i] == 255;
+    texture.format = !compress ? GL_RGBA : opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+    std::vector<uint8_t> level(pixels, pixels + static_cast<size_t>(width) * height * 4);
+    int level_width = width, level_height = height;
+    for (;;) {
+      BakedTextureLevel entry{};
+      entry.offset = texture.data.size();
+      entry.width = static_cast<uint32_t>(level_width);
+      entry.height = static_cast<uint32_t>(level_height);
+      if (texture.format == GL_RGBA) texture.data.insert(texture.data.end(), level.begin(), level.end());
+      else EncodeBlocks(level.data(), level_width, level_height, texture.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, texture.data);
+      entry.size = texture.data.size() - entry.offset;
+      texture.levels.push_back(entry);
+      texture.data.resize(Align(texture.data.size()));
+      if (level_width == 1 && level_height == 1) break;
+      level = Downsample(level, level_width, level_height);
+      level_width = std::max(level_width / 2, 1);
+      level_height = std::max(level_height / 2, 1);
+    }
+  }
+
+private:
+  static uint64_t Align(const uint64_t offset) { return (offset + 15) & ~uint64_t(15); }
+
+  // 2x2 box filter; an odd row or column is folded into the last output texel
+  static std::vector<uint8_t> Downsample(const std::vector<uint8_t> &src, const int width, const int height) {
+    const int out_width = std::max(width / 2, 1), out_height = std::max(height / 2, 1);
+    std::vector<uint8_t> dst(static_cast<size_t>(out_width) * out_height * 4);
+    for (int y = 0; y < out_height; y++) {
+      const int y0 = std::min(y * 2, height - 1);
+      const int y1 = y == out_height - 1 ? height : std::min(y * 2 + 2, height);
+      for (int x = 0; x < out_width; x++) {
+        const int x0 = std::min(x * 2, width - 1);
+        const int x1 = x == out_width - 1 ? width : std::min(x * 2 + 2, width);
+        unsigned int sum[4] = {0, 0, 0, 0};
+        for (int sy = y0; sy < y1; sy++)
+          for (int sx = x0; sx < x1; sx++)
+            for (int c = 0; c < 4; c++) sum[c] += src[(static_cast<size_t>(sy) * width + sx) * 4 + c];
+        const unsigned int count = static_cast<unsigned int>((y1 - y0) * (x1 - x0));
+        for (int c = 0; c < 4; c++) dst[(static_cast<size_t>(y) * out_width + x) * 4 + c] = static_cast<uint8_t>((sum[c] + count / 2) / count);
+      }
+    }
+    return dst;
+  }
+
+  static void EncodeBlocks(const uint8_t *pixels, const int width, const int height, const bool alpha, std::vector<uint8_t> &out) {
+    uint8_t block[16 * 4];
+    for (int by = 0; by < height; by += 4) {
+      for (int bx = 0; bx < width; bx += 4) {
+        // edge blocks repeat the last row/column
+        for (int y = 0; y < 4; y++)
+          for (int x = 0; x < 4; x++)
+            std::memcpy(block + (y * 4 + x) * 4, pixels + (static_cast<size_t>(std::min(by + y, height - 1)) * width + std::min(bx + x, width - 1)) * 4, 4);
+        if (alpha) EncodeAlphaBlock(block, out);
+        EncodeColorBlock(block, out);
+      }
+    }
+  }
+
+  static uint16_t To565(const float *c) {
+    const auto q = [](const float v, const int max) { return static_cast<unsigned int>(std::min(std::max(v, 0.0f), 255.0f) * max / 255.0f + 0.5f); };
+    return static_cast<uint16_t>((q(c[0], 31) << 11) | (q(c[1], 63) << 5) | q(c[2], 31));
+  }
+
+  static void From565(const uint16_t v, int *c) {
+    c[0] = ((v >> 11) & 31) * 255 / 31;
+    c[1] = ((v >> 5) & 63) * 255 / 63;
+    c[2] = (v & 31) * 255 / 31;
+  }
+
+  // BC1 colour block: endpoints at the extremes of the block's principal axis, inset by 1/16 of the range,
+  // then each texel takes the nearest of the four palette colours.
+  static void EncodeColorBlock(const uint8_t *block, std::vector<uint8_t> &out) {
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++)
+      for (int c = 0; c < 3; c++) mean[c] += block[i * 4 + c] / 16.0f;
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+      const float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+      cov[0] += r * r, cov[1] += r * g, cov[2] += r * b, cov[3] += g * g, cov[4] += g * b, cov[5] += b * b;
+    }
+    float axis[3] = {1, 1, 1};
+    for (int iteration = 0; iteration < 8; iteration++) {
+      const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+      const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+      const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+      const float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+      if (length <= 0.0f) break;
+      axis[0] = x / length, axis[1] = y / length, axis[2] = z / length;
+    }
+    float low = 1e30f, high = -1e30f;
+    for (int i = 0; i < 16; i++) {
+      const float t = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+      low = std::min(low, t), high = std::max(high, t);
+    }
+    const float inset = (high - low) / 16.0f;
+    const float axis_length2 = std::max(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2], 1e-12f);
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++) {
+      end0[c] = mean[c] + axis[c] * (high - inset) / axis_length2;
+      end1[c] = mean[c] + axis[c] * (low + inset) / axis_length2;
+    }
+    uint16_t color0 = To565(end0), color1 = To565(end1);
+    if (color0 < color1) std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+      int palette[4][3];
+      From565(color0, palette[0]);
+      From565(color1, palette[1]);
+      for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+      }
+      for (int i = 0; i < 16; i++) {
+        int best = 0, best_distance = INT32_MAX;
+        for (int p = 0; p < 4; p++) {
+          int distance = 0;
+          for (int c = 0; c < 3; c++) distance += (block[i * 4 + c] - palette[p][c]) * (block[i * 4 + c] - palette[p][c]);
+          if (distance < best_distance) best = p, best_distance = distance;
+        }
+        indices |= static_cast<uint32_t>(best) << (i * 2);
+      }
+    }
+    const uint8_t bytes[8] = {static_cast<uint8_t>(color0), static_cast<uint8_t>(color0 >> 8), static_cast<uint8_t>(color1), static_cast<uint8_t>(color1 >> 8),
+                              static_cast<uint8_t>(indices), static_cast<uint8_t>(indices >> 8), static_cast<uint8_t>(indices >> 16), static_cast<uint8_t>(indices >> 24)};
+    out.insert(out.end(), bytes, bytes + 8);
+  }
+
+  // BC3 alpha block in 8-value mode between the block's alpha extremes
+  static void EncodeAlphaBlock(const uint8_t *block, std::vector<uint8_t> &out) {
+    int alpha0 = 0, alpha1 = 255;
+    for (int i = 0; i < 16; i++) alpha0 = std::max<int>(alpha0, block[i * 4 + 3]), alpha1 = std::min<int>(alpha1, block[i * 4 + 3]);
+    uint64_t indices = 0;
+    if (alpha0 != alpha1) {
+      int palette[8] = {alpha0, alpha1};
+      for (int p = 1; p < 7; p++) palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+      for (int i = 0; i < 16; i++) {
+        int best = 0;
+        for (int p = 1; p < 8; p++)
+          if (std::abs(block[i * 4 + 3] - palette[p]) < std::abs(block[i * 4 + 3] - palette[best])) best = p;
+        indices |= static_cast<uint64_t>(best) << (i * 3);
+      }
+    }
+    out.push_back(static_cast<uint8_t>(alpha0));
+    out.push_back(static_cast<uint8_t>(alpha1));
+    for (int b = 0; b < 6; b++) out.push_back(static_cast<uint8_t>(indices >> (b * 8)));
+  }
+
+  static bool ReadCache(const std::string &source_path, const uint64_t source_hash, const uint64_t source_size, const bool compress, const bool flip,
+                        BakedTexture &texture) {
+    MappedFile file(CachePath(source_path, compress));
+    if (!file.IsOpen() || file.Size() < sizeof(BakedTextureHeader)) return false;
+    BakedTextureHeader header;
+    std::memcpy(&header, file.Data(), sizeof(header));
+    if (header.magic != kBakedTextureMagic || header.version != kBakedTextureVersion || header.source_hash != source_hash || header.source_size != source_size ||
+        header.compress != static_cast<uint32_t>(compress) || header.flip != static_cast<uint32_t>(flip) || header.level_count == 0)
+      return false;
+    const uint64_t data_offset = Align(sizeof(BakedTextureHeader) + uint64_t(header.level_count) * sizeof(BakedTextureLevel));
+    if (data_offset > file.Size()) return false;
+    texture.format = header.format;
+    texture.levels.resize(header.level_count);
+    std::memcpy(texture.levels.data(), file.Data() + sizeof(BakedTextureHeader), header.level_count * sizeof(BakedTextureLevel));
+    for (const auto &level : texture.levels)
+      if (data_offset + level.offset + level.size > file.Size()) return false;
+    texture.data.assign(file.Data() + data_offset, file.Data() + file.Size());
+    return true;
+  }
+
+  // written through a per-thread temporary file like MeshCache::Write
+  static bool WriteCache(const std::string &source_path, const uint64_t source_hash, const uint64_t source_size, const bool compress, const bool flip,
+                         const BakedTexture &texture) {
+    BakedTextureHeader header{};
+    header.magic = kBakedTextureMagic;
+    header.version = kBakedTextureVersion;
+    header.source_hash = source_hash;
+    header.source_size = source_size;
+    header.format = texture.format;
+    header.width = texture.levels[0].width;
+    header.height = texture.levels[0].height;
+    header.level_count = static_cast<uint32_t>(texture.levels.size());
+    header.compress = compress;
+    header.flip = flip;
+
+    const std::string cache_path = CachePath(source_path, compress);
+    const std::string temp_path = cache_path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+      std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+      if (!out) return false;
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char *>(texture.levels.data()), texture.levels.size() * sizeof(BakedTextureLevel));
+      while (static_cast<uint64_t>(out.tellp()) < Align(sizeof(header) + texture.levels.size() * sizeof(BakedTextureLevel))) out.put('\0');
+      out.write(reinterpret_cast<const char *>(texture.data.data()), texture.data.size());
+      if (!out) return false;
+    }
+    std::remove(cache_path.c_str());
+    return std::rename(temp_path.c_str(), cache_path.c_str()) == 0;
+  }
+};
+#endif
@@ -0,0 +1,175 @@
+#pragma once
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// VRAM the cache may hold before it evicts textures no model references any more
+constexpr size_t def_texture_budget = 256 * 1024 * 1024;
+
+// canonical form of a file path for use as a cache key: forward slashes, no "." or empty segments, ".." folded into
+// its parent where possible, and case-folded on Windows.
+inline std::string CanonicalPath(const std::string &path) {
+  std::vector<std::string> segments;
+  std::string segment;
+  const bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+  for (size_t i = 0; i <= path.size(); i++) {
+    const char c = i < path.size() ? path[i] : '/';
+    if (c != '/' && c != '\\') {
+      segment += c;
+      continue;
+    }
+    if (segment == "..") {
+      if (!segments.empty() && segments.back() != "..") segments.pop_back();
+      else if (!absolute) segments.push_back(segment);
+    } else if (!segment.empty() && segment != ".")
+      segments.push_back(segment);
+    segment.clear();
+  }
+  std::string canonical = absolute ? "/" : "";
+  for (size_t i = 0; i < segments.size(); i++) canonical += (i ? "/" : "") + segments[i];
+#ifdef _WIN32
+  for (auto &c : canonical) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+#endif
+  return canonical;
+}
+
+// one row of TextureCache::Report
+struct TextureCacheEntry {
+  std::string path;
+  unsigned int id;
+  size_t references;
+  size_t vram_bytes;
+  bool resident;// false while the placeholder is shown
+};
+
+// Process-wide texture cache shared by every model. Textures are keyed by canonical path and reference counted;
+// a texture nobody references stays cached until the VRAM held by the cache exceeds the budget, then the least
+// recently released ones are evicted first. All calls must be made on the thread owning the GL context.
+class TextureCache {
+public:
+  static TextureCache &Global() {
+    static TextureCache cache;
+    return cache;
+  }
+
+  // returns the texture for file_path, streaming it in on first use. Every Acquire is paired with a Release.
+  // compress requests block compression when the texture is first loaded, see TextureStreamer::Request.
+  unsigned int Acquire(const std::string &file_path, const bool compress = true) {
+    const std::string key = CanonicalPath(file_path);
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+      Entry entry;
+      entry.id = TextureStreamer::Global().Request(file_path, compress);
+      entry.vram_bytes = 4;// the 1x1 placeholder
+      it = entries.emplace(key, std::move(entry)).first;
+      by_id[it->second.id] = key;
+      vram_bytes += it->second.vram_bytes;
+      misses++;
+    } else {
+      if (it->second.references == 0) unused.erase(it->second.unused_position);
+      hits++;
+    }
+    it->second.references++;
+    return it->second.id;
+  }
+
+  void Release(const unsigned int texture_id) {
+    const auto key = by_id.find(texture_id);
+    if (key == by_id.end()) return;
+    Entry &entry = entries[key->second];
+    if (entry.references == 0 || --entry.references > 0) return;
+    entry.unused_position = unused.insert(unused.end(), key->second);
+    Evict();
+  }
+
+  // advances the texture streamer and records the size of every texture that became resident. Call once per frame.
+  void Update(const size_t byte_budget = def_stream_budget) {
+    completed.clear();
+    TextureStreamer::Global().Update(byte_budget, &completed);
+    for (const auto &texture : completed) {
+      const auto key = by_id.find(texture.texture_id);
+      if (key == by_id.end()) continue;
+      Entry &entry = entries[key->second];
+      vram_bytes -= entry.vram_bytes;
+      entry.vram_bytes = texture.vram_bytes;
+      entry.resident = true;
+      vram_bytes += entry.vram_bytes;
+    }
+    if (!completed.empty()) Evict();
+  }
+
+  void SetBudget(const size_t bytes) {
+    budget = bytes;
+    Evict();
+  }
+
+  size_t Budget() const { return budget; }
+  size_t VramBytes() const { return vram_bytes; }
+  size_t Count() const { return entries.size(); }
+  size_t Hits() const { return hits; }
+  size_t Misses() const { return misses; }
+
+  // per-texture VRAM held by the cache, largest first
+  std::vector<TextureCacheEntry> Report() const {
+    std::vector<TextureCacheEntry> report;
+    report.reserve(entries.size());
+    for (const auto &entry : entries) report.push_back(TextureCacheEntry{entry.first, entry.second.id, entry.second.references, entry.second.vram_bytes, entry.second.resident});
+    std::sort(report.begin(), report.end(), [](const TextureCacheEntry &a, const TextureCacheEntry &b) { return a.vram_bytes > b.vram_bytes; });
+    return report;
+  }
+
+  // deletes every texture regardless of references. Call before the context is destroyed.
+  void Clear() {
+    for (const auto &entry : entries) TextureStreamer::Global().Release(entry.second.id);
+    entries.clear();
+    by_id.clear();
+    unused.clear();
+    vram_bytes = 0;
+  }
+
+private:
+  struct Entry {
+    unsigned int id = 0;
+    size_t references = 0;
+    size_t vram_bytes = 0;
+    bool resident = false;
+    std::list<std::string>::iterator unused_position;// valid while references == 0
+  };
+
+  std::unordered_map<std::string, Entry> entries;
+  std::unordered_map<unsigned int, std::string> by_id;
+  std::list<std::string> unused;// unreferenced textures, least recently released first
+  std::vector<TextureStreamer::Completed> completed;
+  size_t budget = def_texture_budget;
+  size_t vram_bytes = 0;
+  size_t hits = 0;
+  size_t misses = 0;
+  bool warned = false;
+
+  void Evict() {
+    while (vram_bytes > budget && !unused.empty()) {
+      const auto it = entries.find(unused.front());
+      unused.pop_front();
+      TextureStreamer::Global().Release(it->second.id);
+      vram_bytes -= it->second.vram_bytes;
+      by_id.erase(it->second.id);
+      entries.erase(it);
+    }
+    if (vram_bytes > budget && !warned) {
+      std::cout << "WARNING::TEXTURE_CACHE:: textures in use hold " << vram_bytes / (1024 * 1024) << " MiB, over the budget of " << budget / (1024 * 1024) << " MiB\n";
+      warned = true;
+    } else if (vram_bytes <= budget)
+      warned = false;
+  }
+};
+#endif
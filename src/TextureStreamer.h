@@ -0,0 +1,255 @@
+#pragma once
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+#include "TextureBaker.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// bytes copied into the pixel unpack buffer per Update(), i.e. per frame
+constexpr size_t def_stream_budget = 4 * 1024 * 1024;
+
+// Loads textures without stalling the render thread. Request() hands out a texture id at once, holding a 1x1 placeholder;
+// worker threads load the baked mip chain of each image (see TextureBaker, which bakes it on first use), and Update() copies
+// it into a pixel unpack buffer a slice per frame. Once a texture is complete in the buffer, its levels replace the
+// placeholder, keeping the same id.
+// Request, Update, Release and Shutdown must be called on the thread owning the GL context.
+class TextureStreamer {
+public:
+  static TextureStreamer &Global() {
+    static TextureStreamer streamer;
+    return streamer;
+  }
+
+  explicit TextureStreamer(unsigned int thread_count = std::max(std::thread::hardware_concurrency() / 2, 1u)) {
+    for (unsigned int i = 0; i < thread_count; i++) workers.emplace_back(&TextureStreamer::WorkerLoop, this);
+  }
+
+  ~TextureStreamer() { StopWorkers(); }
+
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+  // returns a texture showing the placeholder until file_path has been loaded and uploaded.
+  // compress asks for block compression (colour maps); it is ignored when the driver lacks S3TC.
+  unsigned int Request(const std::string &file_path, const bool compress = true) {
+    unsigned int texture_id;
+    glGenTextures(1, &texture_id);
+    static const unsigned char placeholder[4] = {128, 128, 128, 255};
+    GLState::Global().BindTexture(0, texture_id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(Image{texture_id, next_serial++, file_path, compress && SupportsS3tc(), BakedTexture()});
+      pending++;
+    }
+    job_ready.notify_one();
+    return texture_id;
+  }
+
+  // a texture that finished streaming during Update
+  struct Completed {
+    unsigned int texture_id;
+    size_t vram_bytes;// all mip levels
+  };
+
+  // advances the uploads by at most byte_budget bytes of pixel data. Call once per frame.
+  // textures that became resident are appended to completed when given.
+  void Update(const size_t byte_budget = def_stream_budget, std::vector<Completed> *completed = nullptr) {
+    size_t budget = byte_budget;
+    while (budget > 0) {
+      if (active.baked.levels.empty()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ready.empty()) return;
+        active = std::move(ready.front());
+        ready.pop_front();
+        active_copied = 0;
+      }
+      if (!active.texture_id) {
+        FinishActive();// released while waiting
+        continue;
+      }
+
+      const size_t size = active.baked.data.size();
+      if (!pbo) glGenBuffers(1, &pbo);
+      GLState::Global().BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+      if (active_copied == 0 && pbo_size < size) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_STREAM_DRAW);
+        pbo_size = size;
+      }
+      const size_t slice = std::min(budget, size - active_copied);
+      // the first slice orphans whatever the previous upload may still be reading
+      const GLbitfield access = GL_MAP_WRITE_BIT | (active_copied == 0 ? GL_MAP_INVALIDATE_BUFFER_BIT : GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+      void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, static_cast<GLintptr>(active_copied), static_cast<GLsizeiptr>(slice), access);
+      if (dst) {
+        std::memcpy(dst, active.baked.data.data() + active_copied, slice);
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) active_copied += slice;
+        else active_copied = 0;// buffer contents were lost, start over next frame
+      }
+      budget -= slice;
+
+      if (dst && active_copied == size) {
+        // replace the placeholder with the baked levels, sourced from the unpack buffer
+        const BakedTexture &baked = active.baked;
+        size_t vram_bytes = 0;
+        GLState::Global().BindTexture(0, active.texture_id);
+        for (size_t i = 0; i < baked.levels.size(); i++) {
+          const BakedTextureLevel &level = baked.levels[i];
+          const auto *offset = reinterpret_cast<const void *>(static_cast<uintptr_t>(level.offset));
+          const auto width = static_cast<GLsizei>(level.width), height = static_cast<GLsizei>(level.height);
+          if (baked.Compressed()) glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), baked.format, width, height, 0, static_cast<GLsizei>(level.size), offset);
+          else glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+          vram_bytes += level.size;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(baked.levels.size() - 1));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        if (completed) completed->push_back(Completed{active.texture_id, vram_bytes});
+        FinishActive();
+      }
+      // unbound again: any other texture upload would read from it
+      GLState::Global().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      if (!dst) return;
+    }
+  }
+
+  // deletes a texture handed out by Request, dropping its upload if it is still in flight.
+  void Release(const unsigned int texture_id) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto &image : jobs)
+        if (image.texture_id == texture_id) image.texture_id = 0;
+      for (auto &image : ready)
+        if (image.texture_id == texture_id) image.texture_id = 0;
+      // by serial: the id may be handed out again before the worker finishes
+      for (const auto &loading : in_progress)
+        if (loading.texture_id == texture_id) cancelled.push_back(loading.serial);
+    }
+    if (active.texture_id == texture_id) active.texture_id = 0;
+    GLState::Global().DeleteTextures(1, &texture_id);
+  }
+
+  // number of requested textures that still show their placeholder
+  size_t Pending() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending;
+  }
+
+  // stops the workers and frees the GL objects of the streamer. Call before the context is destroyed.
+  void Shutdown() {
+    StopWorkers();
+    active = Image{};
+    ready.clear();
+    if (pbo) GLState::Global().DeleteBuffers(1, &pbo);
+    pbo = 0;
+    pbo_size = 0;
+  }
+
+private:
+  struct Image {
+    unsigned int texture_id = 0;// 0 once released
+    uint64_t serial = 0;        // tells apart requests that got the same recycled texture id
+    std::string file_path;
+    bool compress = false;
+    BakedTexture baked;
+  };
+
+  std::vector<std::thread> workers;
+  mutable std::mutex mutex;
+  std::condition_variable job_ready;
+  std::deque<Image> jobs;
+  std::deque<Image> ready;
+  struct Loading {
+    unsigned int texture_id;
+    uint64_t serial;
+  };
+
+  std::vector<Loading> in_progress;// images the workers are loading right now
+  std::vector<uint64_t> cancelled; // serials of images released while being loaded
+  uint64_t next_serial = 1;
+  size_t pending = 0;
+  bool stopping = false;
+
+  // render thread only
+  Image active;
+  size_t active_copied = 0;
+  unsigned int pbo = 0;
+  size_t pbo_size = 0;
+
+  static bool SupportsS3tc() {
+    static const bool supported = [] {
+      GLint count = 0;
+      glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+      for (GLint i = 0; i < count; i++) {
+        const auto *name = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+        if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) return true;
+      }
+      return false;
+    }();
+    return supported;
+  }
+
+  void FinishActive() {
+    active = Image{};
+    std::lock_guard<std::mutex> lock(mutex);
+    pending--;
+  }
+
+  void StopWorkers() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    job_ready.notify_all();
+    for (auto &worker : workers) worker.join();
+    workers.clear();
+  }
+
+  void WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      job_ready.wait(lock, [this] { return stopping || !jobs.empty(); });
+      if (stopping) return;
+      Image image = std::move(jobs.front());
+      jobs.pop_front();
+      if (!image.texture_id) {
+        pending--;
+        continue;
+      }
+      in_progress.push_back(Loading{image.texture_id, image.serial});
+      lock.unlock();
+      const bool loaded = TextureBaker::Load(image.file_path, image.compress, def_texture_flip, image.baked);
+      lock.lock();
+      in_progress.erase(std::find_if(in_progress.begin(), in_progress.end(), [&image](const Loading &loading) { return loading.serial == image.serial; }));
+      const auto released = std::find(cancelled.begin(), cancelled.end(), image.serial);
+      if (released != cancelled.end()) {
+        cancelled.erase(released);
+        pending--;
+        continue;
+      }
+      if (!loaded) {
+        std::cout << "Texture failed to load at path: " << image.file_path << '\n';
+        pending--;
+        continue;
+      }
+      ready.push_back(std::move(image));
+    }
+  }
+};
+#endif
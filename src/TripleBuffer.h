@@ -0,0 +1,77 @@
+#pragma once
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+
+// Hands the latest value of T from one writer thread to one reader thread without locks or waiting. The writer fills
+// Back and publishes it; the reader takes the newest published value with Update and reads it through Front. The two
+// sides never touch the same copy, so the reader always sees a whole value, and values published between two
+// Updates are skipped rather than queued. Each side belongs to the first thread that publishes or updates through it;
+// debug builds assert that no other thread does.
+template <typename T>
+class TripleBuffer {
+public:
+  TripleBuffer() = default;
+
+  explicit TripleBuffer(const T &initial) { Reset(initial); }
+
+  TripleBuffer(const TripleBuffer &) = delete;
+  TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+  // sets every copy to value. Only while neither side is in use.
+  void Reset(const T &value) {
+    for (auto &buffer : buffers) buffer = value;
+    back = 0;
+    middle.store(1, std::memory_order_relaxed);
+    front = 2;
+    writer_thread.store(std::thread::id(), std::memory_order_relaxed);
+    reader_thread.store(std::thread::id(), std::memory_order_relaxed);
+  }
+
+  // writer side: the copy to fill before Publish. It holds an older value, not necessarily the last one published.
+  T &Back() { return buffers[back]; }
+
+  // writer side: makes Back the newest value and hands the writer a free copy
+  void Publish() {
+    CheckThread(writer_thread);
+    back = middle.exchange(static_cast<uint8_t>(back | def_fresh), std::memory_order_acq_rel) & def_index;
+  }
+
+  // reader side: takes the newest value if one was published since the last Update. returns false if Front is unchanged.
+  bool Update() {
+    CheckThread(reader_thread);
+    if (!(middle.load(std::memory_order_relaxed) & def_fresh)) return false;
+    front = middle.exchange(front, std::memory_order_acq_rel) & def_index;
+    return true;
+  }
+
+  // reader side: the value taken by the last Update
+  const T &Front() const { return buffers[front]; }
+
+private:
+  static constexpr uint8_t def_index = 0x3;
+  static constexpr uint8_t def_fresh = 0x4;// set in middle while it holds a value the reader has not taken
+
+  T buffers[3];
+  uint8_t back = 0; // owned by the writer
+  std::atomic<uint8_t> middle{1};
+  uint8_t front = 2;// owned by the reader
+  std::atomic<std::thread::id> writer_thread{std::thread::id()};
+  std::atomic<std::thread::id> reader_thread{std::thread::id()};
+
+  // claims the side for the calling thread on first use, a second thread on the same side would corrupt the buffer
+  static void CheckThread(std::atomic<std::thread::id> &owner) {
+#ifndef NDEBUG
+    std::thread::id expected;
+    const std::thread::id self = std::this_thread::get_id();
+    if (!owner.compare_exchange_strong(expected, self, std::memory_order_relaxed)) assert(expected == self && "TripleBuffer side used from a second thread");
+#else
+    (void) owner;
+#endif
+  }
+};
+#endif
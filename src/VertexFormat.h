@@ -0,0 +1,183 @@
+#pragma once
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Optional vertex streams. The position is always present; everything else is only stored when the mesh has it
+// and the importer was asked for it.
+enum vertex_attribute : uint32_t {
+  k_vertex_normal = 1u << 0,  // octahedral snorm16x2, location 1
+  k_vertex_texcoord = 1u << 1,// half2, location 2
+  k_vertex_tangent = 1u << 2, // tangent + bitangent, octahedral snorm16x2 each, locations 3 and 4
+  k_vertex_skin = 1u << 3     // bone ids uint16x4 + weights unorm8x4, locations 5 and 6
+};
+
+// first of the four locations of the per-instance model matrix read by instanced.vs
+constexpr GLuint def_instance_matrix_location = 8;
+
+// streams requested by default: what shader.vs and instanced.vs read. Ask for more once a shader reads them.
+constexpr uint32_t def_vertex_attributes = k_vertex_texcoord;
+
+// Interleaved vertex format of one mesh. Offsets are byte offsets into a vertex, 0 for absent streams
+// (the position always lives at offset 0).
+struct VertexLayout {
+  uint32_t attributes;
+  uint32_t stride;
+  uint32_t normal_offset;
+  uint32_t texcoord_offset;
+  uint32_t tangent_offset;
+  uint32_t bitangent_offset;
+  uint32_t bone_offset;
+  uint32_t weight_offset;
+
+  bool Has(const vertex_attribute attribute) const { return (attributes & attribute) != 0; }
+
+  static VertexLayout Make(const uint32_t attributes) {
+    VertexLayout layout{};
+    layout.attributes = attributes;
+    uint32_t offset = 3 * sizeof(float);
+    if (attributes & k_vertex_normal) {
+      layout.normal_offset = offset;
+      offset += 2 * sizeof(int16_t);
+    }
+    if (attributes & k_vertex_texcoord) {
+      layout.texcoord_offset = offset;
+      offset += 2 * sizeof(uint16_t);
+    }
+    if (attributes & k_vertex_tangent) {
+      layout.tangent_offset = offset;
+      layout.bitangent_offset = offset + 2 * sizeof(int16_t);
+      offset += 4 * sizeof(int16_t);
+    }
+    if (attributes & k_vertex_skin) {
+      layout.bone_offset = offset;
+      layout.weight_offset = offset + 4 * sizeof(uint16_t);
+      offset += 4 * sizeof(uint16_t) + 4 * sizeof(uint8_t);
+    }
+    layout.stride = offset;
+    return layout;
+  }
+
+  // points the attributes of the currently bound VAO at the currently bound GL_ARRAY_BUFFER, starting at base_offset.
+  void Apply(const size_t base_offset = 0) const {
+    const auto at = [base_offset](const uint32_t offset) { return reinterpret_cast<void *>(base_offset + offset); };
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, at(0));
+    // vertex normals
+    if (Has(k_vertex_normal)) {
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, at(normal_offset));
+    } else glDisableVertexAttribArray(1);
+    // vertex texture coords
+    if (Has(k_vertex_texcoord)) {
+      glEnableVertexAttribArray(2);
+      glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, at(texcoord_offset));
+    } else glDisableVertexAttribArray(2);
+    // vertex tangent and bitangent
+    if (Has(k_vertex_tangent)) {
+      glEnableVertexAttribArray(3);
+      glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, stride, at(tangent_offset));
+      glEnableVertexAttribArray(4);
+      glVertexAttribPointer(4, 2, GL_SHORT, GL_TRUE, stride, at(bitangent_offset));
+    } else {
+      glDisableVertexAttribArray(3);
+      glDisableVertexAttribArray(4);
+    }
+    // ids and weights
+    if (Has(k_vertex_skin)) {
+      glEnableVertexAttribArray(5);
+      glVertexAttribIPointer(5, 4, GL_UNSIGNED_SHORT, stride, at(bone_offset));
+      glEnableVertexAttribArray(6);
+      glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, at(weight_offset));
+    } else {
+      glDisableVertexAttribArray(5);
+      glDisableVertexAttribArray(6);
+    }
+  }
+};
+
+// points locations def_instance_matrix_location..+3 of the currently bound VAO at the glm::mat4 per instance stored
+// in the currently bound GL_ARRAY_BUFFER
+inline void ApplyInstanceMatrix() {
+  for (GLuint column = 0; column < 4; column++) {
+    const GLuint location = def_instance_matrix_location + column;
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<void *>(column * sizeof(glm::vec4)));
+    glVertexAttribDivisor(location, 1);
+  }
+}
+
+// octahedral mapping of a unit vector onto [-1, 1]^2
+inline glm::vec2 OctahedralEncode(glm::vec3 n) {
+  const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+  if (l1 <= 0.0f) return glm::vec2(0.0f);
+  n /= l1;
+  glm::vec2 p(n.x, n.y);
+  if (n.z < 0.0f) {
+    p = glm::vec2((1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+  }
+  return p;
+}
+
+inline glm::vec3 OctahedralDecode(const glm::vec2 p) {
+  glm::vec3 n(p.x, p.y, 1.0f - std::fabs(p.x) - std::fabs(p.y));
+  const float t = glm::clamp(-n.z, 0.0f, 1.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return glm::normalize(n);
+}
+
+// stores one vertex of a full-precision mesh in the compact layout. dst must hold layout.stride bytes.
+template <typename FullVertex>
+void PackVertex(const FullVertex &vertex, const VertexLayout &layout, uint8_t *dst) {
+  std::memcpy(dst, &vertex.Position, 3 * sizeof(float));
+  const auto put_octahedral = [](const glm::vec3 &v, uint8_t *out) {
+    const glm::vec2 p = OctahedralEncode(v);
+    const uint16_t packed[2] = {glm::packSnorm1x16(p.x), glm::packSnorm1x16(p.y)};
+    std::memcpy(out, packed, sizeof(packed));
+  };
+  if (layout.Has(k_vertex_normal)) put_octahedral(vertex.Normal, dst + layout.normal_offset);
+  if (layout.Has(k_vertex_texcoord)) {
+    const uint16_t packed[2] = {glm::packHalf1x16(vertex.TexCoords.x), glm::packHalf1x16(vertex.TexCoords.y)};
+    std::memcpy(dst + layout.texcoord_offset, packed, sizeof(packed));
+  }
+  if (layout.Has(k_vertex_tangent)) {
+    put_octahedral(vertex.Tangent, dst + layout.tangent_offset);
+    put_octahedral(vertex.Bitangent, dst + layout.bitangent_offset);
+  }
+  if (layout.Has(k_vertex_skin)) {
+    uint16_t ids[4];
+    uint8_t weights[4];
+    for (int i = 0; i < 4; i++) {
+      ids[i] = static_cast<uint16_t>(glm::clamp(vertex.m_BoneIDs[i], 0, 65535));
+      weights[i] = glm::packUnorm1x8(vertex.m_Weights[i]);
+    }
+    std::memcpy(dst + layout.bone_offset, ids, sizeof(ids));
+    std::memcpy(dst + layout.weight_offset, weights, sizeof(weights));
+  }
+}
+
+// 16 bit indices whenever every vertex is addressable with them
+inline GLenum ChooseIndexType(const size_t vertex_count) { return vertex_count <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+
+inline size_t IndexSize(const GLenum index_type) { return index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+inline void PackIndices(const std::vector<unsigned int> &indices, const GLenum index_type, std::vector<uint8_t> &out) {
+  out.resize(indices.size() * IndexSize(index_type));
+  if (index_type == GL_UNSIGNED_INT) {
+    if (!indices.empty()) std::memcpy(out.data(), indices.data(), out.size());
+    return;
+  }
+  auto *dst = reinterpret_cast<uint16_t *>(out.data());
+  for (size_t i = 0; i < indices.size(); i++) dst[i] = static_cast<uint16_t>(indices[i]);
+}
+#endif
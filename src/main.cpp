@@ -1,5 +1,5 @@
-#include "Glad/glad.h"
-#include "GLFW//glfw3.h"
+#include "glad/glad.h"
+#include "GLFW/glfw3.h"
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
@@ -11,16 +11,27 @@
 #include "ImGui/imgui_internal.h"
 
 #include "Camera.h"
+#include "CpuProfiler.h"
 #include "Model.h"
+#include "GpuProfiler.h"
+#include "Keyboard.h"
+#include "ModelInstances.h"
+#include "ModelLoader.h"
+#include "OffscreenTarget.h"
 #include "Shader.h"
+#include "Simulation.h"
 // #include "mygui.h"
 
 #include "ecal/ecal.h"
 #include "ecal/msg/protobuf/publisher.h"
 #include "fusion.pb.h"
+#include "FusionPayload.h"
 
 #include "stb_image.h"
-#include <windows.h>
+#include <csignal>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
 
 #pragma region Settings
 // settings
@@ -28,6 +39,10 @@ constexpr unsigned int scr_width = 1920;
 constexpr unsigned int scr_height = 1080;
 
 int window_rt_w, window_rt_h;
+// --headless [WxH]: no visible window, frames are drawn into an OffscreenTarget and nothing is presented
+bool headless = false;
+// set by SIGINT/SIGTERM; ends the main loop so the Finalize region still runs
+volatile std::sig_atomic_t stop_requested = 0;
 // camera
 Camera camera(glm::vec3(-173.45f, 50.15f, -39.39f), glm::vec3(0.0f, 1.0f, 0.0f), 4.2f, -14.60f);
 float last_x = scr_width / 2.0f;
@@ -57,12 +72,18 @@ std::unique_ptr<Model> y;
 std::unique_ptr<Model> z;
 std::unique_ptr<Model> pivot;
 std::unique_ptr<Model> dynamic;
+// axis, pivot and dynamic share axis.obj and are drawn as instances of it
+std::unique_ptr<ModelInstances> gizmos;
 
+// where the tools start; from then on the simulation owns their poses
 glm::vec3 pivot_pos(-100.0f, 49.0f, -9.0f);
 
 glm::vec3 dynamic_pos(-34.0f, 24.0f, -30.0f);
 
-float ani_value;
+float lod_error_pixels = def_lod_error_pixels;
+
+// span of the CPU trace written from the debug panel
+float trace_seconds = static_cast<float>(def_cpu_trace_seconds);
 
 #pragma endregion
 
@@ -74,52 +95,52 @@ void mouse_callback(GLFWwindow *window, double x_pos_in, double y_pos_in);
 
 void scroll_callback(GLFWwindow *window, double x_offset, double y_offset);
 
+void stop_signal_callback(int signal);
+
 void process_input(GLFWwindow *window);
 
-void UpdateModelTransform(std::unique_ptr<Model> &model, const glm::vec3 &pivot_pos, const glm::vec3 &dynamic_pos, GLFWwindow *window);
+void read_tool_input(SimInput &input);
 
-glm::vec3 GetCurrentModelZAxis(const glm::vec3 &rotation);
+void ApplyPose(Model &model, const ToolPose &pose);
 
-void SwitchToEnglishInput();
+void PublishFusionData(const eCAL::CPublisher &publisher, FusionPayload &payload, const SimState &state);
 
 ////////////////////////////////////////////////////implement///////////////////////////////////////////////////////
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 void process_input(GLFWwindow *window) {
-  // if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) glfwSetWindowShouldClose(window, true);
+  // if (Keyboard::Global().Down(GLFW_KEY_ESCAPE)) glfwSetWindowShouldClose(window, true);
 
 #pragma region Camera
-  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) camera.process_keyboard(k_forward, delta_time);
-  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) camera.process_keyboard(k_backward, delta_time);
-  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) camera.process_keyboard(k_left, delta_time);
-  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) camera.process_keyboard(k_right, delta_time);
-  if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) camera.process_keyboard(k_up, delta_time);
-  if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS) camera.process_keyboard(k_down, delta_time);
+  if (Keyboard::Global().Down(GLFW_KEY_W)) camera.process_keyboard(k_forward, delta_time);
+  if (Keyboard::Global().Down(GLFW_KEY_S)) camera.process_keyboard(k_backward, delta_time);
+  if (Keyboard::Global().Down(GLFW_KEY_A)) camera.process_keyboard(k_left, delta_time);
+  if (Keyboard::Global().Down(GLFW_KEY_D)) camera.process_keyboard(k_right, delta_time);
+  if (Keyboard::Global().Down(GLFW_KEY_Q)) camera.process_keyboard(k_up, delta_time);
+  if (Keyboard::Global().Down(GLFW_KEY_Z)) camera.process_keyboard(k_down, delta_time);
 #pragma endregion
+}
 
+// updates input with the tool controls held this frame; it is posted to the simulation
+void read_tool_input(SimInput &input) {
+  const Keyboard &keyboard = Keyboard::Global();
 #pragma region dynamic_pos
-  if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) dynamic_pos.x += 0.5f;
-  if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) dynamic_pos.x -= 0.5f;
-  if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) dynamic_pos.y += 0.5f;
-  if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) dynamic_pos.y -= 0.5f;
-  if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) dynamic_pos.z += 0.5f;
-  if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) dynamic_pos.z -= 0.5f;
+  input.dynamic_move.x = static_cast<float>(keyboard.Down(GLFW_KEY_I)) - static_cast<float>(keyboard.Down(GLFW_KEY_K));
+  input.dynamic_move.y = static_cast<float>(keyboard.Down(GLFW_KEY_U)) - static_cast<float>(keyboard.Down(GLFW_KEY_O));
+  input.dynamic_move.z = static_cast<float>(keyboard.Down(GLFW_KEY_L)) - static_cast<float>(keyboard.Down(GLFW_KEY_J));
 #pragma endregion
 
-  if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) ani_value = 0.05f;
-  if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS) ani_value = 0.9f;
+  if (keyboard.Down(GLFW_KEY_M) || keyboard.Down(GLFW_KEY_N)) {
+    input.ani_value = keyboard.Down(GLFW_KEY_N) ? 0.9f : 0.05f;
+    input.edits.ani_value++;
+  }
 
-  if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS) tube->rotation.z += 1.0f;
-  if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS) tube->rotation.z -= 1.0f;
+  input.tube_roll = static_cast<float>(keyboard.Down(GLFW_KEY_X)) - static_cast<float>(keyboard.Down(GLFW_KEY_C));
+  input.rongeur_roll = static_cast<float>(keyboard.Down(GLFW_KEY_V)) - static_cast<float>(keyboard.Down(GLFW_KEY_B));
 
-  if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS) {
-    upper->rotation.z += 1.0f;
-    lower->rotation.z += 1.0f;
-  }
-  if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS) {
-    upper->rotation.z -= 1.0f;
-    lower->rotation.z -= 1.0f;
-  }
+  input.rongeur_advance = static_cast<float>(keyboard.Down(GLFW_KEY_H)) - static_cast<float>(keyboard.Down(GLFW_KEY_Y));
+  input.tube_advance = static_cast<float>(keyboard.Down(GLFW_KEY_G)) - static_cast<float>(keyboard.Down(GLFW_KEY_T));
+  input.endoscope_advance = static_cast<float>(keyboard.Down(GLFW_KEY_F)) - static_cast<float>(keyboard.Down(GLFW_KEY_R));
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -153,90 +174,152 @@ void mouse_callback(GLFWwindow *window, const double x_pos_in, const double y_po
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 void scroll_callback(GLFWwindow *window, double x_offset, const double y_offset) { camera.process_mouse_scroll(static_cast<float>(y_offset)); }
 
-glm::vec3 GetCurrentModelZAxis(const glm::vec3 &rotation) {
-  auto rot_matrix = glm::mat4(1.0f);
-  rot_matrix = glm::rotate(rot_matrix, glm::radians(rotation.x), glm::vec3(1, 0, 0));
-  rot_matrix = glm::rotate(rot_matrix, glm::radians(rotation.y), glm::vec3(0, 1, 0));
-  rot_matrix = glm::rotate(rot_matrix, glm::radians(rotation.z), glm::vec3(0, 0, 1));
+// SIGINT/SIGTERM: a headless server has no window to close, so it is stopped from outside
+void stop_signal_callback(int signal) { stop_requested = 1; }
 
-  const auto z_axis_local = glm::vec4(0, 0, 1, 0);
-  const glm::vec3 z_axis_world = rot_matrix * z_axis_local;
-  return glm::normalize(z_axis_world);
+
+void ApplyPose(Model &model, const ToolPose &pose) {
+  model.SetPosition(pose.position);
+  model.SetRotation(pose.rotation);
 }
 
-void UpdateModelTransform(std::unique_ptr<Model> &model, const glm::vec3 &pivot_pos, const glm::vec3 &dynamic_pos, GLFWwindow *window) {
-  const glm::vec3 current_dir = GetCurrentModelZAxis(model->rotation);
-  // const glm::vec3 current_dir = model->rotation;
-  const glm::vec3 target_dir = glm::normalize(pivot_pos - dynamic_pos);
-
-  // Calculates the quaternion of rotation between two directions
-  const float dir_threshold = 0.001f;// Small threshold angle in radians
-  const float dot_product = glm::dot(current_dir, target_dir);
-  float angle = acos(glm::clamp(dot_product, -1.0f, 1.0f));
-
-  // if (dot_product < -0.9999f) {
-  //   // Almost in the opposite direction
-  //   angle = glm::pi<float>();// 180°
-  // }
-  if (abs(angle) < dir_threshold) { angle = 0.0f; }
-  if (angle > 0.0f) {
-    glm::vec3 rotation_axis = glm::cross(current_dir, target_dir);
-
-    if (glm::length(rotation_axis) < 0.001f) {
-      // If the current direction and the target direction are almost parallel
-      rotation_axis = glm::vec3(0.0f, 0.0f, 1.0f);// can choose any axis perpendicular to these directions
-    } else { rotation_axis = glm::normalize(rotation_axis); }
-
-    const glm::quat rotation_quat = glm::angleAxis(angle, glm::normalize(rotation_axis));
-    const auto current_quat = glm::quat(glm::radians(model->rotation));
-    const glm::quat new_quat = rotation_quat * current_quat;
-
-    // Build a quaternion rotation
-    model->rotation = glm::degrees(glm::eulerAngles(new_quat));
-  }
-  glm::vec3 position = model->GetPosition();
-  if (model->GetName() == "rongeur") {
-    if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS) position -= target_dir * 40.0f * delta_time;
-    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) position += target_dir * 40.0f * delta_time;
-  }
-  if (model->GetName() == "tube") {
-    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) position -= target_dir * 40.0f * delta_time;
-    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) position += target_dir * 40.0f * delta_time;
-  }
-  if (model->GetName() == "endoscope") {
-    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) position -= target_dir * 40.0f * delta_time;
-    if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS) position += target_dir * 40.0f * delta_time;
-  }
+// fills fusion_data from state and sends it through payload, which writes it into shared memory. Runs on the
+// simulation thread after every step.
+void PublishFusionData(const eCAL::CPublisher &publisher, FusionPayload &payload, const SimState &state) {
+#pragma region mutable_ set_
+  CpuProfiler::Global().Begin("serialize");
+  fusion_data.mutable_endoscope_pos()->set_x(-state.endoscope.position.x);
+  fusion_data.mutable_endoscope_pos()->set_y(state.endoscope.position.y);
+  fusion_data.mutable_endoscope_pos()->set_z(state.endoscope.position.z);
+
+  fusion_data.mutable_endoscope_euler()->set_x(state.endoscope.rotation.x);
+  fusion_data.mutable_endoscope_euler()->set_y(state.endoscope.rotation.y);
+  fusion_data.mutable_endoscope_euler()->set_z(state.endoscope.rotation.z);
+
+  fusion_data.mutable_tube_pos()->set_x(-state.tube.position.x);
+  fusion_data.mutable_tube_pos()->set_y(state.tube.position.y);
+  fusion_data.mutable_tube_pos()->set_z(state.tube.position.z);
+
+  fusion_data.mutable_tube_euler()->set_x(state.tube.rotation.x);
+  fusion_data.mutable_tube_euler()->set_y(state.tube.rotation.y);
+  fusion_data.mutable_tube_euler()->set_z(state.tube.rotation.z);
+
+  fusion_data.mutable_offset()->set_endoscope_offset(-1);
+  fusion_data.mutable_offset()->set_tube_offset(-3);
+  fusion_data.mutable_offset()->set_instrument_switch(60);
+  // fusion_data.mutable_offset()->set_animation_value(dis_0_1(gen));
+  fusion_data.mutable_offset()->set_animation_value(state.ani_value);
+  fusion_data.mutable_offset()->set_pivot_offset(2);
+
+  fusion_data.mutable_rot_coord()->set_x(0);
+  fusion_data.mutable_rot_coord()->set_y(0.7071068f);
+  fusion_data.mutable_rot_coord()->set_z(0);
+  fusion_data.mutable_rot_coord()->set_w(0.7071068f);
+
+  fusion_data.mutable_pivot_pos()->set_x(-10);
+  fusion_data.mutable_pivot_pos()->set_y(4.9f);
+  fusion_data.mutable_pivot_pos()->set_z(-0.9f);
+
+  fusion_data.set_ablation_count(0);
+
+  fusion_data.mutable_haptic()->set_haptic_state(3);
+  fusion_data.mutable_haptic()->set_haptic_offset(-1);
+  fusion_data.mutable_haptic()->set_haptic_force(2);
+
+  fusion_data.set_hemostasis_count(0);
+  fusion_data.set_hemostasis_index(0);
+
+  fusion_data.mutable_soft_tissue()->set_liga_flavum(1);
+  fusion_data.mutable_soft_tissue()->set_disc_yellow_space(1);
+  fusion_data.mutable_soft_tissue()->set_veutro_vessel(1);
+  fusion_data.mutable_soft_tissue()->set_fat(1);
+  fusion_data.mutable_soft_tissue()->set_fibrous_rings(1);
+  fusion_data.mutable_soft_tissue()->set_nucleus_pulposus(1);
+  fusion_data.mutable_soft_tissue()->set_p_longitudinal_liga(1);
+  fusion_data.mutable_soft_tissue()->set_dura_mater(1);
+  fusion_data.mutable_soft_tissue()->set_nerve_root(1);
+
+  fusion_data.set_nerve_root_dance(0);
+
+  fusion_data.mutable_rongeur_pos()->set_x(-state.upper.position.x);
+  fusion_data.mutable_rongeur_pos()->set_y(state.upper.position.y);
+  fusion_data.mutable_rongeur_pos()->set_z(state.upper.position.z);
+
+  fusion_data.mutable_rongeur_rot()->set_x(state.upper.rotation.y);
+  fusion_data.mutable_rongeur_rot()->set_y(state.upper.rotation.x);
+  fusion_data.mutable_rongeur_rot()->set_z(state.upper.rotation.z);
+#pragma endregion
 
-  glm::vec3 direction_to_pivot = pivot_pos - position;
-  float distance_to_pivot = glm::length(direction_to_pivot);
-  position = pivot_pos - target_dir * distance_to_pivot;
-  model->SetPosition(position);
-}
+#pragma region eCAL pub send
 
-void SwitchToEnglishInput() {
-  HKL hklEnglish = LoadKeyboardLayout(TEXT("00000409"), KLF_ACTIVATE);
-  SystemParametersInfo(SPI_SETDEFAULTINPUTLANG, 0, &hklEnglish, 0);
-  PostMessage(HWND_BROADCAST, WM_INPUTLANGCHANGEREQUEST, 0, reinterpret_cast<LPARAM>(hklEnglish));
+  CpuProfiler::Global().End();
+
+  // serializes straight into the shared memory file, or only patches the floats that changed, see FusionPayload
+  CpuProfiler::Global().Begin("publish");
+  const size_t code = publisher.Send(payload);
+  CpuProfiler::Global().End();
+  if (code != payload.LastSize()) { std::cout << "failure\n"; }
+
+#pragma endregion
 }
 
 #pragma endregion
 
-int main() {
+int main(int argc, char *argv[]) {
+  // offline bake: mip every texture below resources/ ahead of time, compressed and not, flipped as at runtime, then exit
+  if (argc > 1 && std::strcmp(argv[1], "--bake-textures") == 0) {
+    const size_t baked = TextureBaker::BakeDirectory(argc > 2 ? argv[2] : "./resources");
+    std::cout << "baked " << baked << " textures\n";
+    return 0;
+  }
+
+  int frame_width = scr_width, frame_height = scr_height;
+  double sim_rate = def_sim_rate_hz;
+  for (int i = 1; i < argc; i++) {
+    // --sim-rate HZ: steps per second of the simulation and publish thread
+    if (std::strcmp(argv[i], "--sim-rate") == 0 && i + 1 < argc) sim_rate = std::atof(argv[i + 1]);
+    if (std::strcmp(argv[i], "--headless") != 0) continue;
+    headless = true;
+    int width, height;
+    if (i + 1 < argc && std::sscanf(argv[i + 1], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+      frame_width = width;
+      frame_height = height;
+    }
+  }
 
 #pragma region Init GLFW
+  CpuProfiler::Global().SetThreadName("main");
+  // the null platform needs no display server or desktop session
+  if (headless) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  if (headless) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+  }
 
-  GLFWwindow *window = glfwCreateWindow(scr_width, scr_height, "PhysicalSimulatedServer", nullptr, nullptr);
+  GLFWwindow *window = glfwCreateWindow(frame_width, frame_height, "PhysicalSimulatedServer", nullptr, nullptr);
+  if (!window && headless) {
+    // no EGL driver: fall back to Mesa's software rasterizer
+    std::cout << "INFO::HEADLESS:: no EGL context, trying OSMesa" << '\n';
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    window = glfwCreateWindow(frame_width, frame_height, "PhysicalSimulatedServer", nullptr, nullptr);
+  }
+  if (!window) {
+    std::cout << "Failed to create GLFW window" << '\n';
+    glfwTerminate();
+    return -1;
+  }
   glfwMakeContextCurrent(window);
 
   // glfwSwapInterval(0);
   glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
   glfwSetCursorPosCallback(window, mouse_callback);
   glfwSetScrollCallback(window, scroll_callback);
+  // keys are read by scancode, so bindings hold under any layout or input method
+  Keyboard::Global().Attach(window);
 
   // tell GLFW to capture our mouse
   // glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -248,32 +331,55 @@ int main() {
     std::cout << "Failed to initialize GLAD" << '\n';
     return -1;
   }
+
+  // headless frames are drawn into an offscreen framebuffer of the requested size
+  OffscreenTarget offscreen;
+  if (headless) {
+    if (!offscreen.Create(frame_width, frame_height)) {
+      glfwTerminate();
+      return -1;
+    }
+    glViewport(0, 0, frame_width, frame_height);
+    std::cout << "INFO::HEADLESS:: rendering " << frame_width << 'x' << frame_height << " offscreen with " << glGetString(GL_RENDERER) << '\n';
+  }
+  // 0 when drawing to the window
+  const GLuint frame_framebuffer = offscreen.Framebuffer();
+  std::signal(SIGINT, stop_signal_callback);
+  std::signal(SIGTERM, stop_signal_callback);
 #pragma endregion
 
 #pragma region Init shader
-  // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-  stbi_set_flip_vertically_on_load(true);
   // configure global opengl state
-  glEnable(GL_DEPTH_TEST);
+  GLState::Global().SetDepthTest(true);
   // build and compile shaders
-  Shader shader("./Shader/shader.vs", "./Shader/shader.fs");
+  Shader shader("./shader/shader.vs", "./shader/shader.fs");
+  // uniform handles are resolved once; setting through them skips the name lookup every frame
+  const Uniform<glm::mat4> u_model = shader.uniform<glm::mat4>("model");
+  // takes the model matrix per instance from a vertex buffer, see ModelInstances
+  Shader instanced_shader("./shader/instanced.vs", "./shader/shader.fs");
+  // draws of a frame are queued and issued together, see RenderQueue
+  RenderQueue render_queue;
 #pragma endregion
 
 #pragma region Init models
-  // load models
-  Model bone("bone", "./resources/test_bone_45.obj");
+  // load models: the imports run on worker threads, the GL uploads happen here as each one finishes
+  ModelLoader loader;
+  std::unique_ptr<Model> bone = loader.Load("bone", "./resources/test_bone_45.obj");
+
+  tube = loader.Load("tube", "./resources/tubeC.obj");
+  endoscope = loader.Load("endoscope", "./resources/endoscope.obj");
+  upper = loader.Load("rongeur", "./resources/upper.obj");
+  lower = loader.Load("rongeur", "./resources/lower.obj");
 
-  tube = std::make_unique<Model>("tube", "./resources/tubeC.obj");
-  endoscope = std::make_unique<Model>("endoscope", "./resources/endoscope.obj");
-  upper = std::make_unique<Model>("rongeur", "./resources/upper.obj");
-  lower = std::make_unique<Model>("rongeur", "./resources/lower.obj");
+  axis = loader.Load("axis", "./resources/axis.obj");
+  x = loader.Load("x", "./resources/x.obj");
+  y = loader.Load("y", "./resources/y.obj");
+  z = loader.Load("z", "./resources/z.obj");
+  pivot = loader.Load("pivot", "./resources/axis.obj");
+  dynamic = loader.Load("dynamic", "./resources/axis.obj");
 
-  axis = std::make_unique<Model>("axis", "./resources/axis.obj");
-  x = std::make_unique<Model>("x", "./resources/x.obj");
-  y = std::make_unique<Model>("y", "./resources/y.obj");
-  z = std::make_unique<Model>("z", "./resources/z.obj");
-  pivot = std::make_unique<Model>("pivot", "./resources/axis.obj");
-  dynamic = std::make_unique<Model>("dynamic", "./resources/axis.obj");
+  loader.Wait();
+  gizmos = std::make_unique<ModelInstances>(axis->asset);
 
   ////////////////////////////////////////////////////implement///////////////////////////////////////////////////////
 
@@ -291,7 +397,7 @@ int main() {
   dynamic->SetPosition(dynamic_pos);
   pivot->SetPosition(pivot_pos);
 
-  bone.SetPosition(glm::vec3(0, 10, 0));
+  bone->SetPosition(glm::vec3(0, 10, 0));
 
   upper->SetPosition(pivot_pos);
   lower->SetPosition(pivot_pos);
@@ -299,7 +405,7 @@ int main() {
   endoscope->SetPosition(pivot_pos);
 
   // draw in wireframe
-  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+  GLState::Global().SetPolygonMode(GL_LINE);
 
 #pragma endregion
 
@@ -379,26 +485,61 @@ int main() {
 #pragma region Init eCAL
   eCAL::Initialize(1, nullptr, "Fusion Publisher");
   eCAL::Process::SetState(proc_sev_healthy, proc_sev_level1, "healthy");
-  const eCAL::CPublisher publisher("fusion");
+  eCAL::CPublisher publisher("fusion");
+  // subscribers read the shared memory file in place, so FusionPayload can write into it without a staging copy
+  publisher.ShmEnableZeroCopy(true);
+  FusionPayload fusion_payload(fusion_data);
+
+#pragma endregion
 
+#pragma region Init simulation
+  // kinematics and publishing run at a fixed rate on their own thread; frames draw its latest state
+  SimState initial_state;
+  initial_state.tube = {tube->GetPosition(), tube->GetRotation()};
+  initial_state.endoscope = {endoscope->GetPosition(), endoscope->GetRotation()};
+  initial_state.upper = {upper->GetPosition(), upper->GetRotation()};
+  initial_state.lower = {lower->GetPosition(), lower->GetRotation()};
+  initial_state.pivot_pos = pivot_pos;
+  initial_state.dynamic_pos = dynamic_pos;
+  Simulation simulation;
+  simulation.Start(initial_state, sim_rate, [&publisher, &fusion_payload](const SimState &state) {
+    PublishFusionData(publisher, fusion_payload, state);
+  });
+  // kept across frames: it carries the latest edit of every field, see SimEdits
+  SimInput sim_input;
 #pragma endregion
 
-  while (!glfwWindowShouldClose(window)) {
+  while (!glfwWindowShouldClose(window) && !stop_requested) {
 
 #pragma region Init
-    SwitchToEnglishInput();
+    CpuProfiler::Global().Begin("frame");
+    CpuProfiler::Global().Begin("Init");
     const auto current_frame = static_cast<float>(glfwGetTime());
     delta_time = current_frame - last_frame;
     last_frame = current_frame;
     process_input(window);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    read_tool_input(sim_input);
+    const SimState &sim_state = simulation.Snapshot();
+    // ImGui changes GL state behind the state cache's back; start every frame from what the driver really has
+    GLState::Global().Invalidate();
+    GLState::Global().ResetStats();
+    // pick up the GPU timings of earlier frames that are ready
+    GpuProfiler::Global().BeginFrame();
+    // finish a slice of the pending texture uploads
+    TextureCache::Global().Update();
+    // close the holes swapped-out meshes left in the geometry pages
+    GeometryArena::Global().Compact();
+    GLState::Global().BindFramebuffer(GL_FRAMEBUFFER, frame_framebuffer);
     // glClearColor(0.7137f, 0.7333f, 0.7686f, 1.0f);// rgb(182, 187, 196)
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);// rgb(182, 187, 196)
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glfwGetWindowSize(window, &window_rt_w, &window_rt_h);
+    CpuProfiler::Global().End();
 #pragma endregion
 
 #pragma region MVP
+    CpuProfiler::Global().Begin("MVP");
+    GpuProfiler::Global().Begin("MVP");
     shader.use();
 
     // view/projection transformations
@@ -406,46 +547,72 @@ int main() {
                                             static_cast<float>(window_rt_w) / static_cast<float>(window_rt_h), 0.1f,
                                             1000.0f);
     glm::mat4 view = camera.get_view_matrix();
-    shader.setMat4("projection", projection);
-    shader.setMat4("view", view);
+    // shared by every program through the FrameConstants uniform block
+    FrameConstants frame_constants{};
+    frame_constants.view = view;
+    frame_constants.projection = projection;
+    frame_constants.view_projection = projection * view;
+    frame_constants.camera_position = glm::vec4(camera.cam_position, 1.0f);
+    frame_constants.time = current_frame;
+    FrameConstantsBuffer::Global().Update(frame_constants);
 
     // render the loaded model
     auto model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
     // translate it down so it's at the center of the scene
     model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));// it's a bit too big for our scene, so scale it down
-    shader.setMat4("model", model);
+    shader.set(u_model, model);
+    GpuProfiler::Global().End();
+    CpuProfiler::Global().End();
 
 #pragma endregion
 
 #pragma region Model
-
+    CpuProfiler::Global().Begin("Model");
+    GpuProfiler::Global().Begin("Model");
+
+    // levels of detail are picked per mesh from the projected error
+    // and meshes outside the view frustum are skipped before any GL call
+    const Frustum frustum = camera.get_frustum(projection);
+    CullStats cull_stats;
+    DrawView draw_view{camera.cam_position, camera.get_projection_scale(static_cast<float>(window_rt_h)), lod_error_pixels, u_model, &frustum, &cull_stats};
+    size_t triangles_drawn = 0;
     /////////////////////////////////////////////////////////////////////
     // our_model.Draw(shader);
-    axis->Draw(shader);
-    x->Draw(shader);
-    y->Draw(shader);
-    z->Draw(shader);
-    pivot->Draw(shader);
-    bone.Draw(shader);
+    triangles_drawn += x->Submit(render_queue, shader, draw_view);
+    triangles_drawn += y->Submit(render_queue, shader, draw_view);
+    triangles_drawn += z->Submit(render_queue, shader, draw_view);
+    triangles_drawn += bone->Submit(render_queue, shader, draw_view);
+    /////////////////////////////////////////////////////////////////////
+    // poses of the latest simulation step
+    dynamic->SetPosition(sim_state.dynamic_pos);
+    pivot->SetPosition(sim_state.pivot_pos);
+    ApplyPose(*tube, sim_state.tube);
+    ApplyPose(*endoscope, sim_state.endoscope);
+    ApplyPose(*upper, sim_state.upper);
+    ApplyPose(*lower, sim_state.lower);
     /////////////////////////////////////////////////////////////////////
-    dynamic->SetPosition(dynamic_pos);
-    UpdateModelTransform(tube, pivot_pos, dynamic_pos, window);
-    UpdateModelTransform(endoscope, pivot_pos, dynamic_pos, window);
-    UpdateModelTransform(upper, pivot_pos, dynamic_pos, window);
-    UpdateModelTransform(lower, pivot_pos, dynamic_pos, window);
+    triangles_drawn += tube->Submit(render_queue, shader, draw_view);
+    triangles_drawn += endoscope->Submit(render_queue, shader, draw_view);
+    triangles_drawn += upper->Submit(render_queue, shader, draw_view);
+    triangles_drawn += lower->Submit(render_queue, shader, draw_view);
     /////////////////////////////////////////////////////////////////////
-    dynamic->Draw(shader);
-    tube->Draw(shader);
-    endoscope->Draw(shader);
-    upper->Draw(shader);
-    lower->Draw(shader);
+    // one draw call per mesh for every copy of axis.obj
+    gizmos->Clear();
+    for (const auto *model : {&axis, &pivot, &dynamic}) gizmos->Add((*model)->GetWorldTransform());
+    triangles_drawn += gizmos->Submit(render_queue, instanced_shader, draw_view);
+    // sorted by program, texture and VAO, so redundant binds are skipped
+    render_queue.Flush();
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::Global().BindFramebuffer(GL_FRAMEBUFFER, frame_framebuffer);
+    GpuProfiler::Global().End();
+    CpuProfiler::Global().End();
 
 #pragma endregion
 
 #pragma region ImGui
+    CpuProfiler::Global().Begin("ImGui");
+    GpuProfiler::Global().Begin("ImGui");
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -477,7 +644,11 @@ int main() {
 #pragma region dynamic_pos
     ImGui::Text("dynamic_pos ");
     ImGui::SameLine();
-    ImGui::DragFloat3("##dynamic_pos", &dynamic_pos.x, 0.01f, 0.0f, 0.0f, "%.2f");
+    glm::vec3 dynamic_value = sim_state.dynamic_pos;
+    if (ImGui::DragFloat3("##dynamic_pos", &dynamic_value.x, 0.01f, 0.0f, 0.0f, "%.2f")) {
+      sim_input.dynamic_pos = dynamic_value;
+      sim_input.edits.dynamic_pos++;
+    }
 
     ImGui::Separator();
 #pragma endregion
@@ -532,18 +703,67 @@ int main() {
 
 #pragma endregion
 
+#pragma region assets
+    ImGui::Text("mesh assets  %zu live, %zu hits, %zu misses", ModelAssetRegistry::Global().LiveCount(), ModelAssetRegistry::Global().Hits(),
+                ModelAssetRegistry::Global().Misses());
+    const TextureCache &texture_cache = TextureCache::Global();
+    ImGui::Text("textures     %zu cached, %zu streaming, %.1f / %.1f MiB", texture_cache.Count(), TextureStreamer::Global().Pending(),
+                texture_cache.VramBytes() / 1048576.0, texture_cache.Budget() / 1048576.0);
+    if (ImGui::TreeNode("texture vram")) {
+      for (const auto &texture : texture_cache.Report())
+        ImGui::Text("%8.2f MiB  %zu refs  %s%s", texture.vram_bytes / 1048576.0, texture.references, texture.path.c_str(), texture.resident ? "" : "  (streaming)");
+      ImGui::TreePop();
+    }
+    ImGui::Text("triangles    %zu", triangles_drawn);
+    ImGui::Text("meshes       %zu visible, %zu culled", cull_stats.visible, cull_stats.culled);
+    const RenderStats &render_stats = render_queue.Stats();
+    ImGui::Text("draws        %zu, %zu programs, %zu vaos, %zu texture binds", render_stats.draws, render_stats.program_switches, render_stats.vao_switches,
+                render_stats.texture_binds);
+    const GeometryArena &geometry_arena = GeometryArena::Global();
+    ImGui::Text("geometry     %zu pages, %.1f / %.1f MiB, %zu batched", geometry_arena.PageCount(), geometry_arena.UsedBytes() / 1048576.0,
+                geometry_arena.CapacityBytes() / 1048576.0, render_stats.batched);
+    const GLStateStats &gl_state_stats = GLState::Global().Stats();
+    ImGui::Text("gl state     %zu calls, %zu filtered", gl_state_stats.issued, gl_state_stats.filtered);
+    ImGui::Text("simulation   %.0f Hz, step %llu, %llu late", simulation.Rate(), static_cast<unsigned long long>(sim_state.tick),
+                static_cast<unsigned long long>(simulation.LateSteps()));
+    ImGui::Text("publish      %llu sends, %llu patched in place", static_cast<unsigned long long>(fusion_payload.Sends()),
+                static_cast<unsigned long long>(fusion_payload.PatchedSends()));
+    if (ImGui::TreeNode("gpu time")) {
+      // a few frames behind, the queries are read back without waiting for the GPU
+      for (const auto &zone : GpuProfiler::Global().Report())
+        ImGui::Text("%-6s %6.3f ms avg, p50 %6.3f, p95 %6.3f, max %6.3f", zone.name, zone.average_ms, zone.p50_ms, zone.p95_ms, zone.max_ms);
+      ImGui::Text("dropped %zu", GpuProfiler::Global().Dropped());
+      ImGui::TreePop();
+    }
+    bool record_cpu_zones = CpuProfiler::Global().Enabled();
+    if (ImGui::Checkbox("cpu zones", &record_cpu_zones)) CpuProfiler::Global().SetEnabled(record_cpu_zones);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80.0f);
+    ImGui::SliderFloat("##trace_seconds", &trace_seconds, 1.0f, 30.0f, "%.0f s");
+    ImGui::SameLine();
+    // open in chrome://tracing or ui.perfetto.dev
+    if (ImGui::Button("dump trace")) CpuProfiler::Global().WriteChromeTrace("./cpu_trace.json", trace_seconds);
+    ImGui::Text("lod error px");
+    ImGui::SameLine();
+    ImGui::SliderFloat("##lod_error_pixels", &lod_error_pixels, 0.0f, 8.0f, "%.1f");
+    ImGui::Separator();
+#pragma endregion
+
 #pragma region endoscope
     ImGui::Separator();
     ImGui::Text("Endoscope   ");
-    glm::vec3 endoscope_pos = endoscope->GetPosition();
+    ToolPose endoscope_edit = sim_state.endoscope;
     ImGui::Text("endoscopepos");
     ImGui::SameLine();
-    if (ImGui::DragFloat3("##endoscope_pos", &endoscope_pos.x, 0.1f, 0.0f, 0.0f, "%.2f")) { endoscope->SetPosition(endoscope_pos); }
+    bool endoscope_edited = ImGui::DragFloat3("##endoscope_pos", &endoscope_edit.position.x, 0.1f, 0.0f, 0.0f, "%.2f");
 
-    glm::vec3 endoscope_rot = endoscope->GetRotation();
     ImGui::Text("endoscoperot");
     ImGui::SameLine();
-    if (ImGui::DragFloat3("##endoscope_rot", &endoscope_rot.x, 0.1f, 0.0f, 0.0f, "%.2f")) { endoscope->SetRotation(endoscope_rot); }
+    endoscope_edited |= ImGui::DragFloat3("##endoscope_rot", &endoscope_edit.rotation.x, 0.1f, 0.0f, 0.0f, "%.2f");
+    if (endoscope_edited) {
+      sim_input.endoscope = endoscope_edit;
+      sim_input.edits.endoscope++;
+    }
 
     ImGui::Separator();
 
@@ -557,83 +777,13 @@ int main() {
 
     //////////////////////////////////////////////////////////////////
     ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-#pragma endregion
-
-#pragma region mutable_ set_
-    fusion_data.mutable_endoscope_pos()->set_x(-endoscope->GetPosition().x);
-    fusion_data.mutable_endoscope_pos()->set_y(endoscope->GetPosition().y);
-    fusion_data.mutable_endoscope_pos()->set_z(endoscope->GetPosition().z);
-
-    fusion_data.mutable_endoscope_euler()->set_x(endoscope->GetRotation().x);
-    fusion_data.mutable_endoscope_euler()->set_y(endoscope->GetRotation().y);
-    fusion_data.mutable_endoscope_euler()->set_z(endoscope->GetRotation().z);
-
-    fusion_data.mutable_tube_pos()->set_x(-tube->GetPosition().x);
-    fusion_data.mutable_tube_pos()->set_y(tube->GetPosition().y);
-    fusion_data.mutable_tube_pos()->set_z(tube->GetPosition().z);
-
-    fusion_data.mutable_tube_euler()->set_x(tube->GetRotation().x);
-    fusion_data.mutable_tube_euler()->set_y(tube->GetRotation().y);
-    fusion_data.mutable_tube_euler()->set_z(tube->GetRotation().z);
-
-    fusion_data.mutable_offset()->set_endoscope_offset(-1);
-    fusion_data.mutable_offset()->set_tube_offset(-3);
-    fusion_data.mutable_offset()->set_instrument_switch(60);
-    // fusion_data.mutable_offset()->set_animation_value(dis_0_1(gen));
-    fusion_data.mutable_offset()->set_animation_value(ani_value);
-    fusion_data.mutable_offset()->set_pivot_offset(2);
-
-    fusion_data.mutable_rot_coord()->set_x(0);
-    fusion_data.mutable_rot_coord()->set_y(0.7071068f);
-    fusion_data.mutable_rot_coord()->set_z(0);
-    fusion_data.mutable_rot_coord()->set_w(0.7071068f);
-
-    fusion_data.mutable_pivot_pos()->set_x(-10);
-    fusion_data.mutable_pivot_pos()->set_y(4.9f);
-    fusion_data.mutable_pivot_pos()->set_z(-0.9f);
-
-    fusion_data.set_ablation_count(0);
-
-    fusion_data.mutable_haptic()->set_haptic_state(3);
-    fusion_data.mutable_haptic()->set_haptic_offset(-1);
-    fusion_data.mutable_haptic()->set_haptic_force(2);
-
-    fusion_data.set_hemostasis_count(0);
-    fusion_data.set_hemostasis_index(0);
-
-    fusion_data.mutable_soft_tissue()->set_liga_flavum(1);
-    fusion_data.mutable_soft_tissue()->set_disc_yellow_space(1);
-    fusion_data.mutable_soft_tissue()->set_veutro_vessel(1);
-    fusion_data.mutable_soft_tissue()->set_fat(1);
-    fusion_data.mutable_soft_tissue()->set_fibrous_rings(1);
-    fusion_data.mutable_soft_tissue()->set_nucleus_pulposus(1);
-    fusion_data.mutable_soft_tissue()->set_p_longitudinal_liga(1);
-    fusion_data.mutable_soft_tissue()->set_dura_mater(1);
-    fusion_data.mutable_soft_tissue()->set_nerve_root(1);
-
-    fusion_data.set_nerve_root_dance(0);
-
-    fusion_data.mutable_rongeur_pos()->set_x(-upper->GetPosition().x);
-    fusion_data.mutable_rongeur_pos()->set_y(upper->GetPosition().y);
-    fusion_data.mutable_rongeur_pos()->set_z(upper->GetPosition().z);
-
-    fusion_data.mutable_rongeur_rot()->set_x(upper->GetRotation().y);
-    fusion_data.mutable_rongeur_rot()->set_y(upper->GetRotation().x);
-    fusion_data.mutable_rongeur_rot()->set_z(upper->GetRotation().z);
-#pragma endregion
-
-#pragma region eCAL pub send
-
-    const int data_size = fusion_data.ByteSizeLong();// NOLINT(*-narrowing-conversions)
-    // NOLINT(clang-diagnostic-shorten-64-to-32, bugprone-narrowing-conversions, cppcoreguidelines-narrowing-conversions)
-    auto data = std::make_unique<uint8_t[]>(data_size);// NOLINT(clang-diagnostic-shadow)
-    fusion_data.SerializePartialToArray(data.get(), data_size);
+    // a headless server has nobody to show the panel to
+    if (!headless) ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    GpuProfiler::Global().End();
+    CpuProfiler::Global().End();
 
-    const int code = publisher.Send(data.get(), data_size);// NOLINT(*-narrowing-conversions)
-    // NOLINT(clang-diagnostic-shorten-64-to-32, bugprone-narrowing-conversions, cppcoreguidelines-narrowing-conversions)
-    if (code != data_size) { std::cout << "failure\n"; }
+    // the next simulation step picks up the controls and edits of this frame
+    simulation.Post(sim_input);
 
 #pragma endregion
 
@@ -645,13 +795,29 @@ int main() {
     //   glfwMakeContextCurrent(backup_current_context);
     // }
 
-    glfwSwapBuffers(window);
+    CpuProfiler::Global().Begin("present");
+    // headless: nothing to present, so the frame rate is not tied to a display
+    if (headless) glFlush();
+    else glfwSwapBuffers(window);
     glfwPollEvents();
+    CpuProfiler::Global().End();
+    CpuProfiler::Global().End();// frame
 #pragma endregion
 
   }
 
 #pragma region Finalize
+  // the simulation thread publishes, so it stops before eCAL does
+  simulation.Stop();
+  // release the shared mesh assets while their GL context is still alive
+  for (auto *model : {&tube, &endoscope, &upper, &lower, &axis, &x, &y, &z, &pivot, &dynamic, &bone}) model->reset();
+  gizmos.reset();
+  GeometryArena::Global().Clear();
+  TextureCache::Global().Clear();
+  TextureStreamer::Global().Shutdown();
+  FrameConstantsBuffer::Global().Clear();
+  offscreen.Clear();
+  GpuProfiler::Global().Clear();
   glfwTerminate();
   eCAL::Finalize();
   return 0;
@@ -0,0 +1,76 @@
+// Threads record zones as fast as they can while the main thread dumps Chrome traces of them. Every dumped zone must
+// carry one of the recorded names and a non-negative duration. Run it under ThreadSanitizer too, the copy of a ring
+// its thread keeps writing is what it checks.
+#include "CpuProfiler.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr int def_thread_count = 4;
+constexpr int def_dump_count = 5;
+constexpr const char *def_trace_path = "cpu_profiler_test.json";
+const char *const def_zone_names[] = {"outer", "inner"};
+
+// counts the zones of a dump with an unknown name or a negative duration
+size_t CountBadZones(const std::string &trace) {
+  size_t bad = 0;
+  for (size_t at = trace.find("\"ph\":\"X\""); at != std::string::npos; at = trace.find("\"ph\":\"X\"", at + 1)) {
+    const size_t name = trace.rfind("{\"name\":\"", at);
+    const std::string zone = trace.substr(name + 9, trace.find('"', name + 9) - name - 9);
+    const size_t dur = trace.find("\"dur\":", at);
+    if ((zone != def_zone_names[0] && zone != def_zone_names[1]) || trace[dur + 6] == '-') bad++;
+  }
+  return bad;
+}
+}// namespace
+
+int main() {
+  std::atomic<bool> done{false};
+  std::atomic<int> recording{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < def_thread_count; t++) {
+    threads.emplace_back([&done, &recording]() {
+      CpuProfiler::Global().SetThreadName("recorder");
+      for (uint64_t zone = 0; !done.load(std::memory_order_relaxed); zone++) {
+        {
+          CpuProfiler::Scope outer(def_zone_names[0]);
+          CpuProfiler::Scope inner(def_zone_names[1]);
+        }
+        if (zone == 0) recording.fetch_add(1, std::memory_order_relaxed);
+        // lets the dump in mid-stream even on a single core
+        if (zone % 64 == 0) std::this_thread::yield();
+      }
+    });
+  }
+
+  // every ring has zones in it before the first dump
+  while (recording.load(std::memory_order_relaxed) < def_thread_count) std::this_thread::yield();
+  size_t zones = 0, bad = 0;
+  for (int dump = 0; dump < def_dump_count; dump++) {
+    zones += CpuProfiler::Global().WriteChromeTrace(def_trace_path, 3600.0);
+    std::ifstream in(def_trace_path);
+    std::stringstream trace;
+    trace << in.rdbuf();
+    bad += CountBadZones(trace.str());
+  }
+  done.store(true, std::memory_order_relaxed);
+  for (auto &thread : threads) thread.join();
+  std::remove(def_trace_path);
+
+  std::cout << zones << " zones dumped, " << bad << " bad\n";
+  if (zones == 0 || bad) {
+    std::cout << "FAIL\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "ok\n";
+  return EXIT_SUCCESS;
+}
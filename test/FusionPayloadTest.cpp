@@ -0,0 +1,100 @@
+// FusionPayload must leave the same bytes in shared memory as serializing the message would, whether a send was
+// written in full or only patched. The buffer is kept between sends as eCAL keeps its file: WriteModified gets the
+// bytes of the previous send, WriteFull a buffer resized to the new message. Floats change between sends, to and from
+// zero and -0.0f too, which move the other floats in the encoding.
+#include "FusionPayload.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+constexpr int def_random_sends = 20000;
+
+// calls function on every float of message, one sub-message down as FusionData has them
+void ForEachFloat(google::protobuf::Message &message, const std::function<void(google::protobuf::Message &, const google::protobuf::FieldDescriptor *)> &function) {
+  const google::protobuf::Descriptor *descriptor = message.GetDescriptor();
+  for (int i = 0; i < descriptor->field_count(); i++) {
+    const google::protobuf::FieldDescriptor *field = descriptor->field(i);
+    if (field->type() == google::protobuf::FieldDescriptor::TYPE_FLOAT) function(message, field);
+    else if (field->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE) ForEachFloat(*message.GetReflection()->MutableMessage(&message, field), function);
+  }
+}
+
+class Sender {
+public:
+  Sender(pb::FusionData::FusionData &fusion_message, FusionPayload &fusion_payload) : message(fusion_message), payload(fusion_payload) {}
+
+  // writes the message as eCAL would, then compares the buffer with the serialized message. returns false on a mismatch.
+  bool Send(const char *what) {
+    const size_t size = payload.GetSize();
+    bool written;
+    if (memory.size() != size) {
+      memory.assign(size, 0xCD);
+      written = payload.WriteFull(memory.data(), size);
+    } else written = payload.WriteModified(memory.data(), size);
+
+    std::vector<uint8_t> expected(size);
+    message.SerializeToArray(expected.data(), static_cast<int>(size));
+    if (!written || payload.LastSize() != size || memory != expected) {
+      std::cout << "FAIL after " << what << ": " << (written ? "" : "write failed, ") << "last size " << payload.LastSize() << " of " << size << '\n';
+      return false;
+    }
+    return true;
+  }
+
+private:
+  pb::FusionData::FusionData &message;
+  FusionPayload &payload;
+  std::vector<uint8_t> memory;
+};
+}// namespace
+
+int main() {
+  pb::FusionData::FusionData message;
+  FusionPayload payload(message);
+  Sender sender(message, payload);
+  bool ok = true;
+
+  // every float set, then one float walked through the transitions that change the layout
+  float next = 1.0f;
+  ForEachFloat(message, [&next](google::protobuf::Message &owner, const google::protobuf::FieldDescriptor *field) {
+    owner.GetReflection()->SetFloat(&owner, field, next);
+    next += 1.0f;
+  });
+  ok = sender.Send("setting every float") && ok;
+  pb::Coord::Vector3 &tube_pos = *message.mutable_tube_pos();
+  const struct {
+    float value;
+    const char *what;
+  } steps[] = {{2.5f, "a value change"}, {0.0f, "a value to zero"}, {3.5f, "zero to a value"}, {-0.0f, "a value to -0.0f"},
+               {0.0f, "-0.0f to zero"},  {-0.0f, "zero to -0.0f"},  {4.5f, "-0.0f to a value"}, {4.5f, "no change"}};
+  for (const auto &step : steps) {
+    tube_pos.set_y(step.value);
+    ok = sender.Send(step.what) && ok;
+  }
+
+  // random values, with zeros and -0.0f among them, on random floats
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> values(-100.0f, 100.0f);
+  std::uniform_int_distribution<int> kinds(0, 255);
+  for (int send = 0; send < def_random_sends && ok; send++) {
+    ForEachFloat(message, [&](google::protobuf::Message &owner, const google::protobuf::FieldDescriptor *field) {
+      const int kind = kinds(random);
+      if (kind < 128) return;// half the floats keep their value, and few turn zero so most sends can be patched
+      owner.GetReflection()->SetFloat(&owner, field, kind == 128 ? 0.0f : kind == 129 ? -0.0f : values(random));
+    });
+    ok = sender.Send("a random change") && ok;
+  }
+
+  std::cout << payload.Sends() << " sends, " << payload.PatchedSends() << " patched\n";
+  if (!ok || payload.PatchedSends() == 0) {
+    std::cout << "FAIL\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "ok\n";
+  return EXIT_SUCCESS;
+}
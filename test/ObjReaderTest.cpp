@@ -0,0 +1,63 @@
+// Relative (negative) face references must resolve to the same vertices however the file is split across threads,
+// including references that reach back into the previous chunk.
+#include "ObjReader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+namespace {
+constexpr int def_face_count = 20000;// about 2.5 MB, well above the chunk size times the thread counts below
+constexpr const char *def_obj_path = "obj_reader_test.obj";
+
+// every face gets three vertices of its own, written right before it and referenced as -3 -2 -1
+bool WriteRelativeObj(const char *path) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  for (int f = 0; f < def_face_count; f++) {
+    for (int k = 0; k < 3; k++) {
+      out << "v " << f << ' ' << k << " 0.5\n";
+      out << "vt " << k * 0.25f << " 0.5\n";
+      out << "vn 0 0 1\n";
+    }
+    out << "f -3/-3/-3 -2/-2/-2 -1/-1/-1\n";
+  }
+  return static_cast<bool>(out);
+}
+
+bool CheckRelativeFaces(const size_t thread_count) {
+  vector<MeshData> meshes;
+  if (!ObjReader::Read(def_obj_path, meshes, k_vertex_normal | k_vertex_texcoord, thread_count) || meshes.size() != 1) {
+    std::cout << "FAIL " << thread_count << " threads: read failed or " << meshes.size() << " meshes\n";
+    return false;
+  }
+  const vector<Vertex> &vertices = meshes[0].vertices;
+  if (vertices.size() != static_cast<size_t>(def_face_count) * 3) {
+    std::cout << "FAIL " << thread_count << " threads: " << vertices.size() << " vertices\n";
+    return false;
+  }
+  size_t wrong = 0;
+  for (int f = 0; f < def_face_count; f++) {
+    for (int k = 0; k < 3; k++) {
+      const Vertex &vertex = vertices[static_cast<size_t>(f) * 3 + k];
+      if (vertex.Position != glm::vec3(f, k, 0.5f) || vertex.TexCoords != glm::vec2(k * 0.25f, 0.5f) || vertex.Normal != glm::vec3(0, 0, 1)) {
+        if (wrong++ == 0) std::cout << "FAIL " << thread_count << " threads: face " << f << " corner " << k << " has the wrong vertex\n";
+      }
+    }
+  }
+  if (wrong) std::cout << "FAIL " << thread_count << " threads: " << wrong << " wrong corners\n";
+  return wrong == 0;
+}
+}// namespace
+
+int main() {
+  if (!WriteRelativeObj(def_obj_path)) {
+    std::cout << "FAIL could not write " << def_obj_path << '\n';
+    return EXIT_FAILURE;
+  }
+  bool ok = true;
+  for (const size_t thread_count : {1, 2, 4, 7}) ok = CheckRelativeFaces(thread_count) && ok;
+  std::remove(def_obj_path);
+  if (ok) std::cout << "ok\n";
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
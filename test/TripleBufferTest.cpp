@@ -0,0 +1,72 @@
+// One thread publishes numbered values through a TripleBuffer as fast as it can while another reads them. Every value
+// the reader sees must be whole (all of its words agree) and newer than the one before, and the last one published
+// must reach the reader. Run it under ThreadSanitizer too, the buffer's memory ordering is what it checks.
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+namespace {
+constexpr uint64_t def_publish_count = 2000000;
+// large enough that a copy racing with a write would show up torn
+constexpr size_t def_value_words = 32;
+
+struct Value {
+  uint64_t words[def_value_words];
+
+  void Fill(const uint64_t sequence) {
+    for (size_t i = 0; i < def_value_words; i++) words[i] = sequence * (i + 1);
+  }
+
+  bool Whole() const {
+    for (size_t i = 1; i < def_value_words; i++)
+      if (words[i] != words[0] * (i + 1)) return false;
+    return true;
+  }
+};
+}// namespace
+
+int main() {
+  Value initial;
+  initial.Fill(0);
+  TripleBuffer<Value> buffer(initial);
+  std::atomic<bool> done{false};
+
+  std::thread writer([&]() {
+    for (uint64_t sequence = 1; sequence <= def_publish_count; sequence++) {
+      buffer.Back().Fill(sequence);
+      buffer.Publish();
+      // lets the reader in mid-stream even on a single core
+      if (sequence % 64 == 0) std::this_thread::yield();
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  uint64_t last = 0, updates = 0, torn = 0, stale = 0;
+  const auto take = [&]() {
+    if (!buffer.Update()) {
+      std::this_thread::yield();
+      return;
+    }
+    const Value &value = buffer.Front();
+    updates++;
+    if (!value.Whole()) torn++;
+    else if (value.words[0] <= last) stale++;
+    else last = value.words[0];
+  };
+  while (!done.load(std::memory_order_acquire)) take();
+  writer.join();
+  // the last value was published before done was set, so this Update is the latest that can take it
+  take();
+
+  std::cout << updates << " updates, " << torn << " torn, " << stale << " out of order, last " << last << '\n';
+  if (torn || stale || last != def_publish_count) {
+    std::cout << "FAIL\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "ok\n";
+  return EXIT_SUCCESS;
+}